@@ -0,0 +1,21 @@
+# Copyright (c) 2018, EPFL/Blue Brain Project
+#                     Raphael Dumusc <raphael.dumusc@epfl.ch>
+#
+# Find the LZ4 compression library
+#
+# Sets:
+#  LZ4_FOUND
+#  LZ4_INCLUDE_DIRS
+#  LZ4_LIBRARIES
+
+find_path(LZ4_INCLUDE_DIR lz4.h)
+find_library(LZ4_LIBRARY NAMES lz4 liblz4)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LZ4 DEFAULT_MSG LZ4_LIBRARY LZ4_INCLUDE_DIR)
+
+if(LZ4_FOUND)
+  set(LZ4_INCLUDE_DIRS ${LZ4_INCLUDE_DIR})
+  set(LZ4_LIBRARIES ${LZ4_LIBRARY})
+endif()
+mark_as_advanced(LZ4_INCLUDE_DIR LZ4_LIBRARY)
@@ -192,14 +192,13 @@ public:
             throw stream_failure("Streaming failure, connection closed");
 
         // Native QImage Format_RGB32 (0xffRRGGBB) corresponds to GL_BGRA ==
-        // deflect::BGRA. But for uncompressed images, Deflect currently only
-        // supports GL_RGBA so the image colors have to be swapped.
-        const auto format = compress ? deflect::BGRA : deflect::RGBA;
-        _image = compress ? image : image.rgbSwapped();
+        // deflect::BGRA. Uncompressed images are converted to RGBA by Deflect.
+        _image = image;
 
         deflect::ImageWrapper deflectImage((const void*)_image.bits(),
                                            _image.width(), _image.height(),
-                                           format);
+                                           deflect::BGRA);
+        deflectImage.pitch = _image.bytesPerLine();
         deflectImage.compressionPolicy =
             compress ? deflect::COMPRESSION_ON : deflect::COMPRESSION_OFF;
         deflectImage.compressionQuality = std::max(1, std::min(quality, 100));
@@ -0,0 +1,99 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "BufferPool.h"
+
+namespace deflect
+{
+BufferPool::BufferPool(const size_t maxBuffers)
+    : _maxBuffers{maxBuffers}
+{
+}
+
+QByteArray BufferPool::acquire(const int capacity)
+{
+    QByteArray buffer;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_buffers.empty())
+        {
+            buffer = std::move(_buffers.back());
+            _buffers.pop_back();
+        }
+    }
+    if (capacity > buffer.capacity())
+        buffer.reserve(capacity);
+    return buffer;
+}
+
+void BufferPool::release(QByteArray&& buffer)
+{
+    QByteArray recycled;
+    recycled.swap(buffer);
+
+    // Writing to a buffer which is still shared would copy it
+    if (!recycled.isDetached())
+        return;
+
+    if (recycled.capacity() == 0)
+        return;
+
+    // Reserving the current capacity prevents resize(0) from freeing it
+    recycled.reserve(recycled.capacity());
+    recycled.resize(0);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_buffers.size() < _maxBuffers)
+        _buffers.emplace_back(std::move(recycled));
+}
+
+size_t BufferPool::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _buffers.size();
+}
+
+void BufferPool::setMaxBuffers(const size_t maxBuffers)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxBuffers = maxBuffers;
+    if (_buffers.size() > maxBuffers)
+        _buffers.resize(maxBuffers);
+}
+}
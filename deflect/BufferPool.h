@@ -0,0 +1,104 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_BUFFERPOOL_H
+#define DEFLECT_BUFFERPOOL_H
+
+#include <deflect/api.h>
+
+#include <QByteArray>
+
+#include <mutex>
+#include <vector>
+
+namespace deflect
+{
+/**
+ * A pool of recycled byte buffers.
+ *
+ * Buffers given back to the pool keep their allocation, so that once the pool
+ * has warmed up the buffers of each new frame are obtained without any heap
+ * allocation. A buffer is only recycled if nobody else still references it.
+ */
+class BufferPool
+{
+public:
+    /**
+     * Create an empty pool.
+     *
+     * @param maxBuffers the maximum number of buffers kept in the pool.
+     */
+    DEFLECT_API explicit BufferPool(size_t maxBuffers = 256);
+
+    /**
+     * Get an empty buffer.
+     *
+     * @param capacity the minimum capacity of the buffer in bytes.
+     * @return an empty buffer, reused from the pool if possible.
+     * @threadsafe
+     */
+    DEFLECT_API QByteArray acquire(int capacity);
+
+    /**
+     * Give a buffer back to the pool.
+     *
+     * @param buffer the buffer to recycle, which is left empty.
+     * @threadsafe
+     */
+    DEFLECT_API void release(QByteArray&& buffer);
+
+    /** @return the number of buffers currently in the pool. @threadsafe */
+    DEFLECT_API size_t size() const;
+
+    /**
+     * Change the maximum number of buffers kept in the pool.
+     *
+     * @param maxBuffers the new maximum, the buffers in excess are freed.
+     * @threadsafe
+     */
+    DEFLECT_API void setMaxBuffers(size_t maxBuffers);
+
+private:
+    size_t _maxBuffers;
+    std::vector<QByteArray> _buffers;
+    mutable std::mutex _mutex;
+};
+}
+
+#endif
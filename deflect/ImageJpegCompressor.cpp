@@ -40,6 +40,7 @@
 #include "ImageJpegCompressor.h"
 
 #include "ImageWrapper.h"
+#include "PixelConverter.h"
 
 #include <iostream>
 #include <sstream>
@@ -79,6 +80,23 @@ int _getTurboJpegFormat(const PixelFormat pixelFormat)
     }
 }
 
+int _getTurboJpegSubsamp(const PixelFormat planarYuvFormat)
+{
+    switch (planarYuvFormat)
+    {
+    case YUV444:
+        return TJSAMP_444;
+    case YUV422:
+        return TJSAMP_422;
+    case YUV420:
+        return TJSAMP_420;
+    default:
+        throw std::invalid_argument("not a planar YUV format " +
+                                    std::to_string((int)planarYuvFormat));
+        return TJSAMP_444;
+    }
+}
+
 int _getTurboJpegSubsamp(const ChromaSubsampling subsampling)
 {
     switch (subsampling)
@@ -98,6 +116,15 @@ int _getTurboJpegSubsamp(const ChromaSubsampling subsampling)
 
 QByteArray ImageJpegCompressor::computeJpeg(const ImageWrapper& sourceImage,
                                             const QRect& imageRegion)
+{
+    QByteArray output;
+    computeJpeg(sourceImage, imageRegion, output);
+    return output;
+}
+
+void ImageJpegCompressor::computeJpeg(const ImageWrapper& sourceImage,
+                                      const QRect& imageRegion,
+                                      QByteArray& output)
 {
     // tjCompress API is incorrect and takes a non-const input buffer, even
     // though it does not modify it. It can "safely" be cast to non-const
@@ -107,35 +134,96 @@ QByteArray ImageJpegCompressor::computeJpeg(const ImageWrapper& sourceImage,
         throw std::invalid_argument(
             "libjpeg-turbo image conversion failure: source image is NULL");
 
-    tjSrcBuffer +=
-        imageRegion.y() * sourceImage.width * sourceImage.getBytesPerPixel();
+    if (isPlanarYuv(sourceImage.pixelFormat))
+    {
+        _computeJpegFromYuv(sourceImage, imageRegion, output);
+        return;
+    }
+
+    tjSrcBuffer += imageRegion.y() * sourceImage.getPitch();
     tjSrcBuffer += imageRegion.x() * sourceImage.getBytesPerPixel();
 
     const int tjWidth = imageRegion.width();
-    // assume imageBuffer isn't padded
-    const int tjPitch = sourceImage.width * sourceImage.getBytesPerPixel();
+    const int tjPitch = int(sourceImage.getPitch());
     const int tjHeight = imageRegion.height();
     const int tjPixelFormat = _getTurboJpegFormat(sourceImage.pixelFormat);
 
     const int tjJpegSubsamp = _getTurboJpegSubsamp(sourceImage.subsampling);
     unsigned long tjJpegSize = tjBufSize(tjWidth, tjHeight, tjJpegSubsamp);
 
-    _tjJpegBuf.resize(tjJpegSize);
+    // Compress straight into the output, which is sent as is
+    output.resize(int(tjJpegSize));
 
     const int tjJpegQual = sourceImage.compressionQuality;
     const int tjFlags = TJFLAG_NOREALLOC; // or: TJFLAG_BOTTOMUP
 
-    auto ptr = _tjJpegBuf.data();
+    auto ptr = (unsigned char*)output.data();
     int err = tjCompress2(_tjHandle, tjSrcBuffer, tjWidth, tjPitch, tjHeight,
                           tjPixelFormat, &ptr, &tjJpegSize, tjJpegSubsamp,
                           tjJpegQual, tjFlags);
     if (err != 0)
+        _throwCompressionError();
+
+    output.resize(int(tjJpegSize));
+}
+
+void ImageJpegCompressor::_computeJpegFromYuv(const ImageWrapper& sourceImage,
+                                              const QRect& imageRegion,
+                                              QByteArray& output)
+{
+#ifdef DEFLECT_USE_LEGACY_LIBJPEGTURBO
+    Q_UNUSED(sourceImage);
+    Q_UNUSED(imageRegion);
+    Q_UNUSED(output);
+    throw std::runtime_error(
+        "libjpeg-turbo >= 1.4 is needed to compress planar YUV images");
+#else
+    ImageRegion region;
+    region.x = imageRegion.x();
+    region.y = imageRegion.y();
+    region.width = imageRegion.width();
+    region.height = imageRegion.height();
+
+    // The planes are already subsampled, so the RGB -> YUV conversion and the
+    // downsampling steps are skipped entirely
+    const auto planes = getYuvPlanes(sourceImage);
+    const auto data = (const unsigned char*)sourceImage.data;
+    const unsigned char* tjPlanes[3];
+    int tjStrides[3];
+    for (size_t p = 0; p < 3; ++p)
     {
-        std::stringstream msg;
-        msg << "libjpeg-turbo image conversion failure: " << tjGetErrorStr();
-        throw std::runtime_error(msg.str());
+        const auto planeRegion = planes.getPlaneRegion(p, region);
+        tjPlanes[p] = data + planes.offset[p] +
+                      planeRegion.y * planes.pitch[p] + planeRegion.x;
+        tjStrides[p] = int(planes.pitch[p]);
     }
 
-    return QByteArray((const char*)ptr, tjJpegSize);
+    const int tjWidth = imageRegion.width();
+    const int tjHeight = imageRegion.height();
+    const int tjJpegSubsamp = _getTurboJpegSubsamp(sourceImage.pixelFormat);
+    unsigned long tjJpegSize = tjBufSize(tjWidth, tjHeight, tjJpegSubsamp);
+
+    // Compress straight into the output, which is sent as is
+    output.resize(int(tjJpegSize));
+
+    const int tjJpegQual = sourceImage.compressionQuality;
+    const int tjFlags = TJFLAG_NOREALLOC;
+
+    auto ptr = (unsigned char*)output.data();
+    int err = tjCompressFromYUVPlanes(_tjHandle, tjPlanes, tjWidth, tjStrides,
+                                      tjHeight, tjJpegSubsamp, &ptr,
+                                      &tjJpegSize, tjJpegQual, tjFlags);
+    if (err != 0)
+        _throwCompressionError();
+
+    output.resize(int(tjJpegSize));
+#endif
+}
+
+void ImageJpegCompressor::_throwCompressionError() const
+{
+    std::stringstream msg;
+    msg << "libjpeg-turbo image conversion failure: " << tjGetErrorStr();
+    throw std::runtime_error(msg.str());
 }
 }
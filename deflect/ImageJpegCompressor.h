@@ -62,6 +62,9 @@ public:
     /**
      * Compute the JPEG imageData for a segment
      *
+     * Planar YUV images are compressed directly from their planes, without
+     * color conversion or chroma subsampling.
+     *
      * @param sourceImage The source image containing uncompressed image data.
      * @param imageRegion The region of the image to be compressed. Must not
      *        exceed image dimensions.
@@ -72,9 +75,26 @@ public:
     DEFLECT_API QByteArray computeJpeg(const ImageWrapper& sourceImage,
                                        const QRect& imageRegion);
 
+    /**
+     * Compute the JPEG imageData for a segment into a given buffer.
+     *
+     * @param sourceImage The source image containing uncompressed image data.
+     * @param imageRegion The region of the image to be compressed. Must not
+     *        exceed image dimensions.
+     * @param output The buffer into which the image is compressed directly.
+     *        Its memory is reused if its capacity is sufficient.
+     * @throw std::invalid_argument if sourceImage.data is nullptr
+     * @throw std::runtime_error if JPEG compression failed
+     */
+    DEFLECT_API void computeJpeg(const ImageWrapper& sourceImage,
+                                 const QRect& imageRegion, QByteArray& output);
+
 private:
     tjhandle _tjHandle;
-    std::vector<unsigned char> _tjJpegBuf;
+
+    void _computeJpegFromYuv(const ImageWrapper& sourceImage,
+                             const QRect& imageRegion, QByteArray& output);
+    void _throwCompressionError() const;
 };
 }
 
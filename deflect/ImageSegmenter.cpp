@@ -41,98 +41,360 @@
 #include "ImageSegmenter.h"
 
 #include "ImageWrapper.h"
+#include "PixelConverter.h"
+#include "moodycamel/blockingconcurrentqueue.h"
 #ifdef DEFLECT_USE_LIBJPEGTURBO
 #include "ImageJpegCompressor.h"
 #endif
+#ifdef DEFLECT_USE_LZ4
+#include <lz4.h>
+#endif
 
+#include <QRect>
+#include <QThreadPool>
 #include <QThreadStorage>
 #include <QtConcurrentMap>
+#include <QtConcurrentRun>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
 namespace deflect
 {
-bool ImageSegmenter::_isOnRightSideOfSideBySideImage(const SegmentTask& segment)
+namespace
+{
+const uint64_t CHECKSUM_SEED = 14695981039346656037ull; // FNV-1a offset basis
+const uint64_t CHECKSUM_PRIME = 1099511628211ull;       // FNV-1a prime
+const uint64_t MAX_HISTORY_AGE = 64;                    // frames
+
+// Adaptive segmentation
+const double SEGMENTS_PER_THREAD = 4.0;         // for load balancing
+const double MIN_SEGMENT_TIME = 0.5e-3;         // seconds
+const double SEGMENT_SIZE_TOLERANCE = 1.5;      // before resizing segments
+const uint MIN_SEGMENT_SIZE = 64;               // pixels
+const uint MAX_SEGMENT_SIZE = 1024;             // pixels
+const uint SEGMENT_SIZE_STEP = 32;              // pixels, without alignment
+const uint64_t ENCODING_STATS_WINDOW = 1 << 24; // pixels
+
+void _checkLosslessCompression(const ImageWrapper& image)
 {
-    return segment.sourceImage->view == View::side_by_side &&
+    // The Server decodes LZ4 segments as RGBA
+    if (image.compressionPolicy == COMPRESSION_LOSSLESS &&
+        isPlanarYuv(image.pixelFormat))
+    {
+        throw std::invalid_argument(
+            "Lossless compression is not supported for planar YUV images");
+    }
+}
+
+bool _isOnRightSideOfSideBySideImage(const Segment& segment,
+                                     const ImageWrapper& image)
+{
+    return image.view == View::side_by_side &&
            segment.view == View::right_eye;
 }
 
-bool ImageSegmenter::generate(const ImageWrapper& image, Handler handler)
+QRect _getImageRegion(const Segment& segment, const ImageWrapper& image)
 {
-    if (image.compressionPolicy == COMPRESSION_ON)
-        return _generateJpeg(image, handler);
-    return _generateRaw(image, handler);
+    QRect imageRegion(segment.parameters.x - image.x,
+                      segment.parameters.y - image.y, segment.parameters.width,
+                      segment.parameters.height);
+
+    if (_isOnRightSideOfSideBySideImage(segment, image))
+        imageRegion.translate(image.width / 2, 0);
+
+    return imageRegion;
 }
 
-Segment ImageSegmenter::createSingleSegment(const ImageWrapper& image)
+// FNV-like hash processing 8 bytes per iteration, with an extra xorshift to
+// propagate the high bits of the product back to the low bits.
+uint64_t _updateChecksum(uint64_t checksum, const char* data, const size_t size)
 {
-    auto segments = _generateSegmentTasks(image);
-    if (segments.size() > 1)
-        throw std::runtime_error(
-            "createSingleSegment only works for small images");
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(uint64_t));
+        checksum = (checksum ^ word) * CHECKSUM_PRIME;
+        checksum ^= checksum >> 29;
+    }
+    for (; i < size; ++i)
+        checksum = (checksum ^ uint8_t(data[i])) * CHECKSUM_PRIME;
+    return checksum;
+}
 
-    auto& segment = segments[0];
+// Call func(row, rowSize) for the rows of a region in each plane of the image
+template <typename Func>
+void _forEachRow(const ImageWrapper& image, const QRect& region, Func func)
+{
+    const auto data = (const char*)image.data;
 
-    if (image.compressionPolicy == COMPRESSION_OFF)
+    if (!isPlanarYuv(image.pixelFormat))
     {
-        segment.imageData.reserve(segment.parameters.width *
-                                  segment.parameters.height *
-                                  image.getBytesPerPixel());
-        segment.parameters.format = Format::rgba;
-        segment.imageData.append((const char*)image.data,
-                                 int(image.getBufferSize()));
+        const auto bytesPerPixel = image.getBytesPerPixel();
+        const size_t imagePitch = image.getPitch();
+        const size_t rowSize = region.width() * bytesPerPixel;
+
+        auto row = data + region.y() * imagePitch + region.x() * bytesPerPixel;
+        for (int i = 0; i < region.height(); ++i, row += imagePitch)
+            func(row, rowSize);
+        return;
     }
-    else
+
+    ImageRegion imageRegion;
+    imageRegion.x = region.x();
+    imageRegion.y = region.y();
+    imageRegion.width = region.width();
+    imageRegion.height = region.height();
+
+    const auto planes = getYuvPlanes(image);
+    for (size_t p = 0; p < 3; ++p)
     {
-#ifdef DEFLECT_USE_LIBJPEGTURBO
-        _computeJpeg(segment, false);
-        if (segment.exception)
-            std::rethrow_exception(segment.exception);
-#else
+        const auto planeRegion = planes.getPlaneRegion(p, imageRegion);
+        const auto pitch = planes.pitch[p];
+
+        auto row = data + planes.offset[p] + planeRegion.y * pitch +
+                   planeRegion.x;
+        for (unsigned int i = 0; i < planeRegion.height; ++i, row += pitch)
+            func(row, size_t(planeRegion.width));
+    }
+}
+
+uint64_t _computeChecksum(const ImageWrapper& image, const QRect& region)
+{
+    uint64_t checksum = CHECKSUM_SEED;
+    _forEachRow(image, region, [&checksum](const char* row, size_t rowSize) {
+        checksum = _updateChecksum(checksum, row, rowSize);
+    });
+    return checksum;
+}
+
+// Copy an image region, converting packed formats to RGBA
+void _appendRegion(QByteArray& buffer, const ImageWrapper& image,
+                   const QRect& region)
+{
+    const auto bytesPerPixel = image.getBytesPerPixel();
+    const size_t imagePitch = image.getPitch();
+    const size_t rowSize = region.width() * bytesPerPixel;
+
+    auto row = (const char*)image.data + region.y() * imagePitch +
+               region.x() * bytesPerPixel;
+
+    if (isPlanarYuv(image.pixelFormat))
+    {
+        _forEachRow(image, region, [&buffer](const char* data, size_t size) {
+            buffer.append(data, int(size));
+        });
+        return;
+    }
+
+    if (image.pixelFormat != RGBA)
+    {
+        const size_t outputRowSize = region.width() * 4;
+        auto offset = size_t(buffer.size());
+        buffer.resize(int(offset + outputRowSize * region.height()));
+        for (int i = 0; i < region.height(); ++i, row += imagePitch)
+        {
+            convertToRgba(row, image.pixelFormat, buffer.data() + offset,
+                          size_t(region.width()));
+            offset += outputRowSize;
+        }
+        return;
+    }
+
+    // Full rows are contiguous in memory
+    if (rowSize == imagePitch)
+    {
+        buffer.append(row, int(rowSize * region.height()));
+        return;
+    }
+
+    buffer.reserve(buffer.size() + int(rowSize * region.height()));
+    for (int i = 0; i < region.height(); ++i, row += imagePitch)
+        buffer.append(row, int(rowSize));
+}
+
+Format _getRawFormat(const PixelFormat pixelFormat)
+{
+    switch (pixelFormat)
+    {
+    case YUV444:
+        return Format::yuv444;
+    case YUV422:
+        return Format::yuv422;
+    case YUV420:
+        return Format::yuv420;
+    default:
+        return Format::rgba;
+    }
+}
+
+#ifdef DEFLECT_USE_LZ4
+void _compressLz4(const char* data, const int size, QByteArray& compressed)
+{
+    compressed.resize(LZ4_compressBound(size));
+    const int compressedSize =
+        LZ4_compress_default(data, compressed.data(), size, compressed.size());
+    if (compressedSize <= 0)
+        throw std::runtime_error("LZ4 compression failed");
+    compressed.resize(compressedSize);
+}
+#endif
+
+bool _isDamaged(const QRect& region, const ImageRegions& damage)
+{
+    for (const auto& damagedRegion : damage)
+    {
+        if (region.intersects(QRect(damagedRegion.x, damagedRegion.y,
+                                    damagedRegion.width,
+                                    damagedRegion.height)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+class ImageSegmenter::Job
+{
+public:
+    Job(const ImageWrapper& image_, const ImageRegions* damage_,
+        const uint64_t frame_)
+        : image(image_)
+        , hasDamage(damage_ != nullptr)
+        , frame(frame_)
+    {
+        if (damage_)
+            damage = *damage_;
+    }
+
+    const ImageWrapper image; // the segments point to this copy
+    ImageRegions damage;
+    const bool hasDamage;
+    const uint64_t frame;
+    uint64_t discards = 0; // when the previous states were loaded
+
+    SegmentTasks segments;
+
+    // Lock-free, as all the compression threads enqueue their results in it.
+    // It is bounded by construction: each segment is enqueued exactly once.
+    moodycamel::BlockingConcurrentQueue<SegmentTask> results;
+    std::atomic<size_t> remaining{0};
+
+    /** @name Concurrent handling, by the generating threads */
+    //@{
+    Handler handler; // set before the job is launched, if enabled
+    std::atomic_bool handlerFailed{false};
+    std::atomic<size_t> queued{0}; // results not handled by the threads
+    //@}
+
+    /** @name Guarded by ImageSegmenter::_jobsMutex */
+    //@{
+    bool scheduled = false;
+    bool generated = false;
+    bool pending = false;
+    JobPtr next; // to be launched once this one is generated
+    //@}
+};
+
+ImageSegmenter::~ImageSegmenter()
+{
+    std::unique_lock<std::mutex> lock(_jobsMutex);
+    _jobsCondition.wait(lock, [this] { return _activeJobs == 0; });
+}
+
+bool ImageSegmenter::generate(const ImageWrapper& image, Handler handler,
+                              const ImageRegions* damage)
+{
+    return handle(createJob(image, damage), handler);
+}
+
+ImageSegmenter::JobPtr ImageSegmenter::createJob(const ImageWrapper& image,
+                                                 const ImageRegions* damage)
+{
+#ifndef DEFLECT_USE_LIBJPEGTURBO
+    if (image.compressionPolicy == COMPRESSION_ON)
         throw std::runtime_error(
-            "LibJpegTurbo not available, needed for createSingleSegment");
+            "LibJpegTurbo not available, needed for sending JPEG compressed "
+            "image");
 #endif
+#ifndef DEFLECT_USE_LZ4
+    if (image.compressionPolicy == COMPRESSION_LOSSLESS)
+        throw std::runtime_error(
+            "LZ4 not available, needed for sending losslessly compressed "
+            "image");
+#endif
+    _checkLosslessCompression(image);
+
+    uint64_t frame = 0;
+    {
+        std::lock_guard<std::mutex> lock(_historyMutex);
+        frame = _frame;
     }
 
-    return segment;
+    auto job = std::make_shared<Job>(image, damage, frame);
+    job->segments =
+        _generateSegmentTasks(job->image, _getSegmentSize(job->image));
+    return job;
 }
 
-void ImageSegmenter::setNominalSegmentDimensions(const uint width,
-                                                 const uint height)
+void ImageSegmenter::start(JobPtr job)
 {
-    _nominalSegmentWidth = width;
-    _nominalSegmentHeight = height;
+    std::unique_lock<std::mutex> lock(_jobsMutex);
+    if (job->scheduled)
+        return;
+
+    _jobsCondition.wait(lock, [this] {
+        return _pendingJobs < std::max(_pipelineDepth, size_t(1));
+    });
+    job->pending = true;
+    ++_pendingJobs;
+    _schedule(job, lock);
 }
 
-bool ImageSegmenter::_generateJpeg(const ImageWrapper& image,
-                                   const Handler& handler)
+bool ImageSegmenter::handle(JobPtr job, Handler handler)
 {
-#ifdef DEFLECT_USE_LIBJPEGTURBO
-    // The resulting Jpeg segments
-    auto segments = _generateSegmentTasks(image);
+    {
+        std::unique_lock<std::mutex> lock(_jobsMutex);
+        if (!job->scheduled)
+        {
+            if (_concurrentHandling)
+                job->handler = handler;
+            _schedule(job, lock);
+        }
+    }
 
-    // start creating JPEGs for each segment, in parallel
-    QtConcurrent::map(segments, std::bind(&ImageSegmenter::_computeJpeg, this,
-                                          std::placeholders::_1, true));
+    if (job->handler)
+        return _awaitConcurrentHandling(job);
 
-    // Sending compressed jpeg segments while they arrive in the queue.
+    // Sending segments while they arrive in the queue.
     // Note: Qt insists that sending (by calling handler()) should happen
     // exclusively from the QThread where the socket lives. Sending from the
     // worker threads triggers a qWarning.
+    const auto count = job->segments.size();
     size_t i = 0;
     try
     {
         bool result = true;
-        for (; i < segments.size(); ++i)
+        SegmentTask segment;
+        for (; i < count; ++i)
         {
-            const auto segment = _sendQueue.dequeue();
+            job->results.wait_dequeue(segment);
             if (segment.exception)
                 std::rethrow_exception(segment.exception);
+            _encodeSkippedSegment(*job, segment);
             if (!handler(segment))
                 result = false;
+            recycle(std::move(segment.imageData));
         }
+        _finishHandling(*job, result);
+        _release(*job);
         return result;
     }
     catch (...)
@@ -141,96 +403,542 @@ bool ImageSegmenter::_generateJpeg(const ImageWrapper& image,
         // handler. Otherwise the remaining threads may wait forever leading to
         // a deadlock in QApplication destructor.
         ++i;
-        for (; i < segments.size(); ++i)
-            _sendQueue.dequeue();
+        SegmentTask segment;
+        for (; i < count; ++i)
+        {
+            job->results.wait_dequeue(segment);
+            recycle(std::move(segment.imageData));
+        }
+        _finishHandling(*job, false);
+        _release(*job);
         std::rethrow_exception(std::current_exception());
     }
+}
+
+void ImageSegmenter::setPipelineDepth(const size_t depth)
+{
+    std::lock_guard<std::mutex> lock(_jobsMutex);
+    _pipelineDepth = depth;
+    _jobsCondition.notify_all();
+}
+
+size_t ImageSegmenter::getPipelineDepth() const
+{
+    std::lock_guard<std::mutex> lock(_jobsMutex);
+    return _pipelineDepth;
+}
+
+void ImageSegmenter::setConcurrentHandling(const bool enable)
+{
+    std::lock_guard<std::mutex> lock(_jobsMutex);
+    _concurrentHandling = enable;
+}
+
+void ImageSegmenter::recycle(QByteArray&& imageData)
+{
+    _buffers.release(std::move(imageData));
+}
+
+void ImageSegmenter::setExecutor(Executor executor, const size_t threadCount)
+{
+    std::unique_lock<std::mutex> lock(_jobsMutex);
+    _jobsCondition.wait(lock, [this] { return _activeJobs == 0; });
+    _executor = std::move(executor);
+    _threadCount = threadCount;
+}
+
+Segment ImageSegmenter::createSingleSegment(const ImageWrapper& image,
+                                            const ImageRegions* damage)
+{
+    _checkLosslessCompression(image);
+
+    QSize nominalSize;
+    {
+        std::lock_guard<std::mutex> lock(_segmentationMutex);
+        nominalSize = QSize(_nominalSegmentWidth, _nominalSegmentHeight);
+    }
+    auto segments = _generateSegmentTasks(image, nominalSize);
+    if (segments.size() > 1)
+        throw std::runtime_error(
+            "createSingleSegment only works for small images");
+
+    uint64_t frame = 0;
+    {
+        std::lock_guard<std::mutex> lock(_historyMutex);
+        frame = _frame;
+    }
+    _loadPreviousStates(segments, damage, frame);
+
+    auto& segment = segments[0];
+
+    if (image.compressionPolicy == COMPRESSION_OFF)
+    {
+        _copyRaw(segment);
+    }
+    else if (image.compressionPolicy == COMPRESSION_LOSSLESS)
+    {
+#ifdef DEFLECT_USE_LZ4
+        _computeLz4(segment);
+#else
+        throw std::runtime_error(
+            "LZ4 not available, needed for createSingleSegment");
+#endif
+    }
+    else
+    {
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+        _computeJpeg(segment);
 #else
-    throw std::runtime_error(
-        "LibJpegTurbo not available, needed for sending JPEG compressed image");
+        throw std::runtime_error(
+            "LibJpegTurbo not available, needed for createSingleSegment");
 #endif
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_historyMutex);
+        _storeStates(segments, frame, _history);
+    }
+    return segment;
 }
 
-void ImageSegmenter::_computeJpeg(SegmentTask& segment, const bool sendSegment)
+void ImageSegmenter::finishFrame()
 {
-#ifdef DEFLECT_USE_LIBJPEGTURBO
-    QRect imageRegion(segment.parameters.x - segment.sourceImage->x,
-                      segment.parameters.y - segment.sourceImage->y,
-                      segment.parameters.width, segment.parameters.height);
+    std::lock_guard<std::mutex> lock(_historyMutex);
+    ++_frame;
 
-    if (_isOnRightSideOfSideBySideImage(segment))
-        imageRegion.translate(segment.sourceImage->width / 2, 0);
+    // Forget about the segments which are no longer generated, for instance
+    // after a resize of the image
+    for (auto it = _history.begin(); it != _history.end();)
+    {
+        if (it->second.frame + MAX_HISTORY_AGE < _frame)
+            it = _history.erase(it);
+        else
+            ++it;
+    }
+}
 
-    // turbojpeg handles need to be per thread, and this function is called from
-    // multiple threads by QtConcurrent::map
-    static QThreadStorage<ImageJpegCompressor> compressor;
+void ImageSegmenter::resetHistory()
+{
+    std::lock_guard<std::mutex> lock(_historyMutex);
+    _history.clear();
+    _pendingHistory.clear();
+    ++_discards;
+}
+
+void ImageSegmenter::setNominalSegmentDimensions(const uint width,
+                                                 const uint height)
+{
+    std::lock_guard<std::mutex> lock(_segmentationMutex);
+    _nominalSegmentWidth = width;
+    _nominalSegmentHeight = height;
+}
+
+void ImageSegmenter::setAdaptiveSegmentation(const bool enable,
+                                             const uint alignment)
+{
+    std::lock_guard<std::mutex> lock(_segmentationMutex);
+    _adaptiveSegmentation = enable;
+    _segmentAlignment = alignment;
+    _adaptiveSegmentSize = 0;
+}
+
+void ImageSegmenter::_schedule(JobPtr job, std::unique_lock<std::mutex>& lock)
+{
+    job->scheduled = true;
+    ++_activeJobs;
+
+    // Generate the jobs one after the other, so that the segments of a job
+    // can be compared with the ones of the previous job.
+    auto lastJob = _lastJob.lock();
+    _lastJob = job;
+    if (lastJob && !lastJob->generated)
+    {
+        lastJob->next = job;
+        return;
+    }
+    lock.unlock();
+    _launch(job);
+}
+
+void ImageSegmenter::_launch(JobPtr job)
+{
+    job->discards =
+        _loadPreviousStates(job->segments,
+                            job->hasDamage ? &job->damage : nullptr,
+                            job->frame);
+
+    job->remaining = job->segments.size();
+    if (job->segments.empty())
+    {
+        _finishGeneration(job);
+        return;
+    }
+
+    Executor executor;
+    {
+        std::lock_guard<std::mutex> lock(_jobsMutex);
+        executor = _executor;
+    }
+
+    if (job->image.compressionPolicy == COMPRESSION_ON ||
+        job->image.compressionPolicy == COMPRESSION_LOSSLESS)
+    {
+        // start compressing each segment, in parallel
+        if (executor)
+        {
+            for (auto& segment : job->segments)
+                executor(std::bind(&ImageSegmenter::_generateSegment, this,
+                                   job, std::ref(segment)));
+        }
+        else
+        {
+            QtConcurrent::map(job->segments,
+                              std::bind(&ImageSegmenter::_generateSegment, this,
+                                        job, std::placeholders::_1));
+        }
+    }
+    else
+    {
+        // raw segments are cheap to copy and must be handled in order
+        auto task = std::bind(&ImageSegmenter::_generateSegments, this, job);
+        if (executor)
+            executor(task);
+        else
+            QtConcurrent::run(task);
+    }
+}
+
+void ImageSegmenter::_generateSegment(JobPtr job, SegmentTask& segment)
+{
+    const auto startTime = std::chrono::steady_clock::now();
     try
     {
-        segment.imageData =
-            compressor.localData().computeJpeg(*segment.sourceImage,
-                                               imageRegion);
+        _encodeSegment(segment);
     }
     catch (...)
     {
         segment.exception = std::current_exception();
     }
 
+    // Skipped segments say nothing about the encoding cost
+    if (!segment.imageData.isEmpty())
+    {
+        const auto elapsed = std::chrono::steady_clock::now() - startTime;
+        _encodingTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             elapsed)
+                             .count();
+        _encodedPixels += segment.parameters.width * segment.parameters.height;
+    }
+
+    // The handled copy must be the only owner of the data to be recycled
+    auto result = segment;
+    segment.imageData = QByteArray();
+
+    if (job->handler && !result.exception)
+    {
+        try
+        {
+            _encodeSkippedSegment(*job, result);
+            if (!job->handler(result))
+                job->handlerFailed = true;
+            recycle(std::move(result.imageData));
+        }
+        catch (...)
+        {
+            result.exception = std::current_exception();
+        }
+    }
+    if (!job->handler || result.exception)
+    {
+        ++job->queued;
+        job->results.enqueue(std::move(result));
+    }
+    if (--job->remaining == 0)
+        _finishGeneration(job);
+}
+
+void ImageSegmenter::_generateSegments(JobPtr job)
+{
+    for (auto& segment : job->segments)
+        _generateSegment(job, segment);
+}
+
+void ImageSegmenter::_finishGeneration(JobPtr job)
+{
+    // The states are only committed once the segments have been handled, but
+    // the next job may be generated in the meantime and compared with them.
+    const bool failed =
+        job->handlerFailed ||
+        std::any_of(job->segments.begin(), job->segments.end(),
+                    [](const SegmentTask& segment) {
+                        return bool(segment.exception);
+                    });
+    if (!failed)
+    {
+        std::lock_guard<std::mutex> lock(_historyMutex);
+        _storeStates(job->segments, job->frame, _pendingHistory);
+    }
+
+    JobPtr next;
+    {
+        std::lock_guard<std::mutex> lock(_jobsMutex);
+        job->generated = true;
+        next = std::move(job->next);
+        --_activeJobs;
+        _jobsCondition.notify_all();
+    }
+    if (next)
+        _launch(next);
+}
+
+bool ImageSegmenter::_awaitConcurrentHandling(JobPtr job)
+{
+    {
+        std::unique_lock<std::mutex> lock(_jobsMutex);
+        _jobsCondition.wait(lock, [&job] { return job->generated; });
+    }
+
+    // Only the failed segments were queued
+    std::exception_ptr exception;
+    SegmentTask segment;
+    for (size_t i = 0; i < job->queued; ++i)
+    {
+        job->results.wait_dequeue(segment);
+        if (!exception)
+            exception = segment.exception;
+        recycle(std::move(segment.imageData));
+    }
+    _finishHandling(*job, !exception && !job->handlerFailed);
+    _release(*job);
+
+    if (exception)
+        std::rethrow_exception(exception);
+    return !job->handlerFailed;
+}
+
+void ImageSegmenter::_finishHandling(const Job& job, const bool success)
+{
+    std::lock_guard<std::mutex> lock(_historyMutex);
+    if (success)
+    {
+        // Jobs are handled in the order they were generated
+        _storeStates(job.segments, job.frame, _history);
+        for (const auto& segment : job.segments)
+        {
+            const auto it = _pendingHistory.find(_makeKey(segment));
+            if (it != _pendingHistory.end() && it->second.frame <= job.frame)
+                _pendingHistory.erase(it);
+        }
+        return;
+    }
+
+    // The Server may have received any subset of the segments, so they must
+    // all be sent again, as well as the ones compared with pending states.
+    for (const auto& segment : job.segments)
+        _history.erase(_makeKey(segment));
+    _pendingHistory.clear();
+    ++_discards;
+}
+
+void ImageSegmenter::_release(Job& job)
+{
+    std::lock_guard<std::mutex> lock(_jobsMutex);
+    if (job.pending)
+    {
+        job.pending = false;
+        --_pendingJobs;
+        _jobsCondition.notify_all();
+    }
+}
+
+void ImageSegmenter::_encodeSegment(SegmentTask& segment)
+{
+    switch (segment.sourceImage->compressionPolicy)
+    {
+    case COMPRESSION_ON:
+        _computeJpeg(segment);
+        break;
+    case COMPRESSION_LOSSLESS:
+        _computeLz4(segment);
+        break;
+    default:
+        _copyRaw(segment);
+    }
+}
+
+void ImageSegmenter::_encodeSkippedSegment(const Job& job,
+                                           SegmentTask& segment)
+{
+    if (!segment.imageData.isEmpty() || !segment.inPreviousFrame)
+        return;
+
+    // The previous segment was discarded after this one was compared with it
+    {
+        std::lock_guard<std::mutex> lock(_historyMutex);
+        if (job.discards == _discards)
+            return;
+    }
+    segment.inPreviousFrame = false;
+    _encodeSegment(segment);
+}
+
+void ImageSegmenter::_computeJpeg(SegmentTask& segment)
+{
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+    // turbojpeg handles need to be per thread, and this function is called from
+    // multiple threads by the executor
+    static QThreadStorage<ImageJpegCompressor> compressor;
+    if (!_isUnchanged(segment))
+    {
+        const auto imageRegion = _getImageRegion(segment, *segment.sourceImage);
+        segment.imageData = _buffers.acquire(0);
+        compressor.localData().computeJpeg(*segment.sourceImage, imageRegion,
+                                           segment.imageData);
+    }
     segment.parameters.format = Format::jpeg;
-    if (sendSegment)
-        _sendQueue.enqueue(segment);
 #endif
 }
 
-bool ImageSegmenter::_generateRaw(const ImageWrapper& image,
-                                  const Handler& handler) const
+void ImageSegmenter::_computeLz4(SegmentTask& segment)
 {
-    auto segments = _generateSegmentTasks(image);
-    for (auto& segment : segments)
+#ifdef DEFLECT_USE_LZ4
+    segment.parameters.format = Format::lz4;
+
+    if (_isUnchanged(segment))
+        return;
+
+    const auto& image = *segment.sourceImage;
+    const auto imageRegion = _getImageRegion(segment, image);
+    const auto rowSize = image.width * image.getBytesPerPixel();
+    const int rawSize = imageRegion.width() * imageRegion.height() * 4;
+
+    segment.imageData = _buffers.acquire(LZ4_compressBound(rawSize));
+
+    // Full unpadded RGBA rows can be compressed directly from the image
+    if (image.pixelFormat == RGBA && imageRegion.width() == int(image.width) &&
+        image.getPitch() == rowSize)
     {
-        segment.imageData.reserve(segment.parameters.width *
-                                  segment.parameters.height *
-                                  image.getBytesPerPixel());
-        segment.parameters.format = Format::rgba;
+        const auto offset = imageRegion.y() * rowSize;
+        const auto size = imageRegion.height() * rowSize;
+        _compressLz4((const char*)image.data + offset, int(size),
+                     segment.imageData);
+        return;
+    }
+
+    auto rawData = _buffers.acquire(rawSize);
+    _appendRegion(rawData, image, imageRegion);
+    _compressLz4(rawData.constData(), rawData.size(), segment.imageData);
+    _buffers.release(std::move(rawData));
+#else
+    Q_UNUSED(segment);
+#endif
+}
 
-        if (segments.size() == 1)
+void ImageSegmenter::_copyRaw(SegmentTask& segment)
+{
+    segment.parameters.format = _getRawFormat(segment.sourceImage->pixelFormat);
+
+    if (_isUnchanged(segment))
+        return;
+
+    const auto& image = *segment.sourceImage;
+    const auto imageRegion = _getImageRegion(segment, image);
+
+    // Large enough for RGBA, which is the biggest of the raw formats
+    segment.imageData =
+        _buffers.acquire(imageRegion.width() * imageRegion.height() * 4);
+    _appendRegion(segment.imageData, image, imageRegion);
+}
+
+bool ImageSegmenter::_isUnchanged(SegmentTask& segment) const
+{
+    const auto& image = *segment.sourceImage;
+    if (!image.data)
+        return false;
+
+    const auto imageRegion = _getImageRegion(segment, image);
+
+    // The damage is authoritative, no need to look at the pixels
+    if (segment.damage)
+    {
+        if (!segment.inPreviousFrame ||
+            _isDamaged(imageRegion, *segment.damage))
         {
-            // If we are not segmenting the image, just append the image data
-            segment.imageData.append((const char*)image.data,
-                                     int(image.getBufferSize()));
+            return false;
         }
-        else // Copy the image subregion
+        segment.state = segment.previous;
+        return true;
+    }
+
+    if (!image.skipUnchangedSegments)
+        return false;
+
+    segment.state.checksum = _computeChecksum(image, imageRegion);
+    segment.state.hasChecksum = true;
+
+    return segment.inPreviousFrame && segment.previous.hasChecksum &&
+           segment.state.checksum == segment.previous.checksum;
+}
+
+ImageSegmenter::SegmentKey ImageSegmenter::_makeKey(const Segment& segment)
+{
+    const auto& params = segment.parameters;
+    return std::make_tuple(params.x, params.y, params.width, params.height,
+                           segment.view, segment.channel);
+}
+
+uint64_t ImageSegmenter::_loadPreviousStates(SegmentTasks& segments,
+                                             const ImageRegions* damage,
+                                             const uint64_t frame)
+{
+    std::lock_guard<std::mutex> lock(_historyMutex);
+    for (auto& segment : segments)
+    {
+        segment.damage = damage;
+
+        // Ask the Server to keep the segments which may be skipped next time
+        segment.retained =
+            damage || segment.sourceImage->skipUnchangedSegments;
+        segment.state.retained = segment.retained;
+
+        // The pending states, if any, are more recent than the handled ones
+        const auto key = _makeKey(segment);
+        auto it = _pendingHistory.find(key);
+        if (it == _pendingHistory.end())
         {
-            // assume imageBuffer isn't padded
-            const auto bytesPerPixel = image.getBytesPerPixel();
-            const size_t imagePitch = image.width * bytesPerPixel;
-            size_t offset = segment.parameters.y * imagePitch +
-                            segment.parameters.x * bytesPerPixel;
-
-            if (_isOnRightSideOfSideBySideImage(segment))
-                offset += segment.sourceImage->width / 2 * bytesPerPixel;
-
-            const char* lineData = (const char*)image.data + offset;
-
-            for (uint i = 0; i < segment.parameters.height; ++i)
-            {
-                segment.imageData.append(lineData, segment.parameters.width *
-                                                       bytesPerPixel);
-                lineData += imagePitch;
-            }
+            it = _history.find(key);
+            if (it == _history.end())
+                continue;
         }
 
-        if (!handler(segment))
-            return false;
+        // The Server only keeps the retained segments of the previous frame
+        if (it->second.frame + 1 == frame && it->second.state.retained)
+        {
+            segment.previous = it->second.state;
+            segment.inPreviousFrame = true;
+        }
     }
+    return _discards;
+}
 
-    return true;
+void ImageSegmenter::_storeStates(const SegmentTasks& segments,
+                                  const uint64_t frame, History& target)
+{
+    for (const auto& segment : segments)
+    {
+        auto& history = target[_makeKey(segment)];
+        if (history.frame > frame)
+            continue;
+        history.state = segment.state;
+        history.frame = frame;
+    }
 }
 
 ImageSegmenter::SegmentTasks ImageSegmenter::_generateSegmentTasks(
-    const ImageWrapper& image) const
+    const ImageWrapper& image, const QSize& segmentSize) const
 {
     SegmentTasks segments;
-    for (const auto& params : _makeSegmentParameters(image))
+    for (const auto& params : _makeSegmentParameters(image, segmentSize))
     {
         SegmentTask segment;
         segment.parameters = params;
@@ -257,13 +965,34 @@ ImageSegmenter::SegmentTasks ImageSegmenter::_generateSegmentTasks(
                         segmentsRight.end());
     }
 
+    // Subsampled chroma planes can only be split on even pixels, and the
+    // Server expects raw segments without partial chroma samples
+    const auto format = image.pixelFormat;
+    const bool evenX = format == YUV422 || format == YUV420;
+    const bool evenY = format == YUV420;
+    const bool raw = image.compressionPolicy == COMPRESSION_OFF;
+    for (const auto& segment : segments)
+    {
+        const auto region = _getImageRegion(segment, image);
+        if ((evenX && region.x() % 2 != 0) || (evenY && region.y() % 2 != 0))
+            throw std::invalid_argument(
+                "subsampled YUV segments must start on even pixels!");
+        if (raw && ((evenX && region.width() % 2 != 0) ||
+                    (evenY && region.height() % 2 != 0)))
+        {
+            throw std::invalid_argument(
+                "uncompressed subsampled YUV segments must have even "
+                "dimensions!");
+        }
+    }
+
     return segments;
 }
 
 ImageSegmenter::SegmentParametersList ImageSegmenter::_makeSegmentParameters(
-    const ImageWrapper& image) const
+    const ImageWrapper& image, const QSize& segmentSize) const
 {
-    const auto info = _makeSegmentationInfo(image);
+    const auto info = _makeSegmentationInfo(image, segmentSize);
 
     SegmentParametersList parameters;
     for (uint j = 0; j < info.countY; ++j)
@@ -282,16 +1011,19 @@ ImageSegmenter::SegmentParametersList ImageSegmenter::_makeSegmentParameters(
 }
 
 ImageSegmenter::SegmentationInfo ImageSegmenter::_makeSegmentationInfo(
-    const ImageWrapper& image) const
+    const ImageWrapper& image, const QSize& segmentSize) const
 {
+    const uint segmentWidth = segmentSize.width();
+    const uint segmentHeight = segmentSize.height();
+
     const auto imageWidth =
         image.view == View::side_by_side ? image.width / 2 : image.width;
 
     SegmentationInfo info;
-    info.width = _nominalSegmentWidth;
-    info.height = _nominalSegmentHeight;
+    info.width = segmentWidth;
+    info.height = segmentHeight;
 
-    if (_nominalSegmentWidth == 0 || _nominalSegmentHeight == 0)
+    if (segmentWidth == 0 || segmentHeight == 0)
     {
         info.countX = 1;
         info.countY = 1;
@@ -300,22 +1032,86 @@ ImageSegmenter::SegmentationInfo ImageSegmenter::_makeSegmentationInfo(
         return info;
     }
 
-    info.countX = imageWidth / _nominalSegmentWidth + 1;
-    info.countY = image.height / _nominalSegmentHeight + 1;
+    info.countX = imageWidth / segmentWidth + 1;
+    info.countY = image.height / segmentHeight + 1;
 
-    info.lastWidth = imageWidth % _nominalSegmentWidth;
-    info.lastHeight = image.height % _nominalSegmentHeight;
+    info.lastWidth = imageWidth % segmentWidth;
+    info.lastHeight = image.height % segmentHeight;
 
     if (info.lastWidth == 0)
     {
-        info.lastWidth = _nominalSegmentWidth;
+        info.lastWidth = segmentWidth;
         --info.countX;
     }
     if (info.lastHeight == 0)
     {
-        info.lastHeight = _nominalSegmentHeight;
+        info.lastHeight = segmentHeight;
         --info.countY;
     }
     return info;
 }
+
+QSize ImageSegmenter::_getSegmentSize(const ImageWrapper& image)
+{
+    std::lock_guard<std::mutex> lock(_segmentationMutex);
+    if (!_adaptiveSegmentation)
+        return QSize(_nominalSegmentWidth, _nominalSegmentHeight);
+
+    // Raw segments are copied by a single task, only compression is parallel
+    const bool parallel = image.compressionPolicy == COMPRESSION_ON ||
+                          image.compressionPolicy == COMPRESSION_LOSSLESS;
+    size_t threadCount = 1;
+    if (parallel)
+    {
+        threadCount = _threadCount;
+        if (threadCount == 0)
+            threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    }
+
+    const auto imageWidth =
+        image.view == View::side_by_side ? image.width / 2 : image.width;
+    const double imageArea = double(imageWidth) * image.height;
+    auto area = imageArea / (std::max(threadCount, size_t(1)) *
+                             SEGMENTS_PER_THREAD);
+
+    // Segments which are too quick to encode are dominated by the fixed cost
+    // of a segment (task scheduling, message header, server-side handling)
+    const uint64_t pixels = _encodedPixels;
+    const uint64_t time = _encodingTime;
+    if (pixels > 0 && time > 0)
+    {
+        const auto timePerPixel = time * 1e-9 / pixels;
+        area = std::max(area, MIN_SEGMENT_TIME / timePerPixel);
+
+        // Forget older measurements progressively
+        if (pixels > ENCODING_STATS_WINDOW)
+        {
+            _encodedPixels -= pixels / 2;
+            _encodingTime -= time / 2;
+        }
+    }
+
+    const double size =
+        std::min(std::max(std::sqrt(area), double(MIN_SEGMENT_SIZE)),
+                 double(MAX_SEGMENT_SIZE));
+
+    // Subsampled chroma planes can only be split on even pixels
+    auto step = _segmentAlignment ? _segmentAlignment : SEGMENT_SIZE_STEP;
+    if (step % 2 != 0 &&
+        (image.pixelFormat == YUV422 || image.pixelFormat == YUV420))
+    {
+        step *= 2;
+    }
+
+    // Keep the current dimensions unless they are far from the optimal ones
+    if (_adaptiveSegmentSize > 0 && _adaptiveSegmentSize % step == 0 &&
+        size * SEGMENT_SIZE_TOLERANCE >= _adaptiveSegmentSize &&
+        size <= _adaptiveSegmentSize * SEGMENT_SIZE_TOLERANCE)
+    {
+        return QSize(_adaptiveSegmentSize, _adaptiveSegmentSize);
+    }
+    const auto steps = std::max(uint(std::round(size / step)), 1u);
+    _adaptiveSegmentSize = steps * step;
+    return QSize(_adaptiveSegmentSize, _adaptiveSegmentSize);
+}
 }
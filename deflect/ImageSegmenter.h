@@ -44,10 +44,18 @@
 #include <deflect/api.h>
 #include <deflect/types.h>
 
-#include <deflect/MTQueue.h>
+#include <deflect/BufferPool.h>
 #include <deflect/Segment.h>
 
+#include <QSize>
+
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
 
 namespace deflect
 {
@@ -60,9 +68,19 @@ public:
     /** Construct an ImageSegmenter. */
     DEFLECT_API ImageSegmenter() = default;
 
+    /** Destruct the ImageSegmenter, waiting for all started jobs. */
+    DEFLECT_API ~ImageSegmenter();
+
     /** Function called on each segment. */
     using Handler = std::function<bool(const Segment&)>;
 
+    /** Function executing a task asynchronously. */
+    using Executor = std::function<void(std::function<void()>)>;
+
+    /** The asynchronous generation of the segments of one image. */
+    class Job;
+    using JobPtr = std::shared_ptr<Job>;
+
     /**
      * Generate segments.
      *
@@ -70,14 +88,122 @@ public:
      * executed from the calling thread. When one handle() fails, the remaining
      * handle() calls may or may not be executed.
      *
+     * Segments which are known to be identical to the ones generated at the
+     * same position for the previous frame are neither compressed nor copied:
+     * they are handled with an empty imageData. A segment is known to be
+     * unchanged if it does not intersect the damaged regions, or, if no damage
+     * is given and image.skipUnchangedSegments is set, if its checksum matches.
+     * Only the segments of images which were handled successfully are used
+     * for the comparison.
+     *
      * @param image The image to be segmented.
      * @param handler the function to handle the generated segment.
+     * @param damage optional regions of the image which changed since the
+     *        previous frame, nullptr if unknown.
      * @return true if all image handlers returned true, false on failure.
      * @throw std::runtime_error if JPEG compression failed.
      * @throw std::invalid_argument if JPEG compression arguments are invalid.
      * @see setNominalSegmentDimensions()
+     * @see finishFrame()
+     */
+    DEFLECT_API bool generate(const ImageWrapper& image, Handler handler,
+                              const ImageRegions* damage = nullptr);
+
+    /**
+     * Create a job to generate the segments of an image asynchronously.
+     *
+     * The segments belong to the current frame, regardless of when they are
+     * actually generated.
+     *
+     * @param image The image to be segmented, which must remain valid until
+     *        the job has been handled.
+     * @param damage optional regions of the image which changed since the
+     *        previous frame, nullptr if unknown. It is copied.
+     * @return the job, to be passed to start() and/or handle().
+     * @throw std::invalid_argument if the image cannot be segmented.
+     * @throw std::runtime_error if JPEG compression is not available.
+     * @threadsafe
+     */
+    DEFLECT_API JobPtr createJob(const ImageWrapper& image,
+                                 const ImageRegions* damage = nullptr);
+
+    /**
+     * Start generating the segments of a job in the background.
+     *
+     * Jobs are generated one after the other in the order they were started,
+     * so that the generation of a job overlaps the handling of the previous
+     * ones. Blocks while the number of started jobs which have not been handled
+     * yet reaches the pipeline depth.
+     *
+     * @param job The job to start.
+     * @threadsafe
+     * @see setPipelineDepth()
      */
-    DEFLECT_API bool generate(const ImageWrapper& image, Handler handler);
+    DEFLECT_API void start(JobPtr job);
+
+    /**
+     * Handle the segments of a job, starting it if needed.
+     *
+     * The image data of the segments is recycled once they have been handled,
+     * so the handler must not keep a reference to it.
+     *
+     * @param job The job to handle.
+     * @param handler the function to handle the generated segment.
+     * @return true if all image handlers returned true, false on failure.
+     * @throw std::runtime_error if JPEG compression failed.
+     * @throw std::invalid_argument if JPEG compression arguments are invalid.
+     * @see generate()
+     */
+    DEFLECT_API bool handle(JobPtr job, Handler handler);
+
+    /**
+     * Give the image data of a handled segment back for the next segments.
+     *
+     * @param imageData the data of a segment from createSingleSegment(), which
+     *        is left empty.
+     * @threadsafe
+     */
+    DEFLECT_API void recycle(QByteArray&& imageData);
+
+    /**
+     * Set the maximum number of jobs which can be started ahead of handle().
+     *
+     * @param depth the maximum number of pending jobs (default: 0, meaning that
+     *        jobs are only generated when they are handled).
+     * @threadsafe
+     */
+    DEFLECT_API void setPipelineDepth(size_t depth);
+
+    /** @return the maximum number of pending jobs. @threadsafe */
+    DEFLECT_API size_t getPipelineDepth() const;
+
+    /**
+     * Set the executor for the generation of the segments.
+     *
+     * Waits until the jobs being generated with the previous executor are done.
+     *
+     * @param executor the function which executes the generation tasks, or
+     *        nullptr to use the global QThreadPool (default). It must execute
+     *        all the tasks it receives.
+     * @param threadCount the number of threads of the executor, used by the
+     *        adaptive segmentation (default: 0, unknown).
+     * @threadsafe
+     */
+    DEFLECT_API void setExecutor(Executor executor, size_t threadCount = 0);
+
+    /**
+     * Call the Handler directly from the threads generating the segments.
+     *
+     * This removes the hand-off of the segments to the thread calling
+     * handle(), which then only waits for the generation to complete. It
+     * applies to the jobs which have not been started before handle(), the
+     * segments of the others are still handled by the calling thread. The
+     * Handler must be thread-safe.
+     *
+     * @param enable call the Handler concurrently (default: false).
+     * @threadsafe
+     */
+    DEFLECT_API void setConcurrentHandling(bool enable);
 
     /**
      * Set the nominal segment dimensions.
@@ -92,19 +218,57 @@ public:
      */
     DEFLECT_API void setNominalSegmentDimensions(uint width, uint height);
 
+    /**
+     * Select the segment dimensions automatically for each image.
+     *
+     * Segments are sized so that each thread of the executor gets a few of
+     * them to compress, but not so small that their compression time, measured
+     * on the previous images, becomes negligible compared to the fixed cost of
+     * a segment. The dimensions only change once they are far from the optimal
+     * ones, since segments which change dimensions cannot be skipped.
+     *
+     * @param enable use adaptive dimensions instead of the nominal ones.
+     * @param alignment if non-zero, the dimensions are a multiple of it.
+     * @threadsafe
+     */
+    DEFLECT_API void setAdaptiveSegmentation(bool enable, uint alignment = 0);
+
     /**
      * For a small input image (tested with 64x64, possible for <=512 as well),
      * directly compress it to a single segment which will be enqueued for
      * sending.
      *
      * @param image The image to be compressed.
+     * @param damage optional regions of the image which changed since the
+     *        previous frame, nullptr if unknown.
      * @return the compressed segment.
      * @throw std::invalid_argument if image is too big or invalid JPEG
      *        compression arguments.
      * @throw std::runtime_error if JPEG compression failed.
      * @threadsafe
      */
-    DEFLECT_API Segment createSingleSegment(const ImageWrapper& image);
+    DEFLECT_API Segment
+        createSingleSegment(const ImageWrapper& image,
+                            const ImageRegions* damage = nullptr);
+
+    /**
+     * Mark the end of the current frame.
+     *
+     * The Server only keeps a copy of the segments of the previous frame, so
+     * only those can be skipped when generating the segments of the next one.
+     * @threadsafe
+     */
+    DEFLECT_API void finishFrame();
+
+    /**
+     * Forget the segments generated so far.
+     *
+     * All the segments of the next images are sent, including the ones of the
+     * jobs which were created but not handled yet. To be called when the
+     * Server no longer has the previous segments where they are expected.
+     * @threadsafe
+     */
+    DEFLECT_API void resetHistory();
 
 private:
     struct SegmentationInfo
@@ -119,6 +283,14 @@ private:
         uint lastHeight = 0;
     };
 
+    /** State of a generated segment, to detect unchanged segments. */
+    struct SegmentState
+    {
+        bool hasChecksum = false;
+        uint64_t checksum = 0; //!< Checksum of the source pixels
+        bool retained = false; //!< The Server keeps a copy of it
+    };
+
     struct SegmentTask : Segment
     {
         /** Uncompressed source image used for compression */
@@ -126,25 +298,95 @@ private:
 
         /** Holds potential exception from compression thread */
         std::exception_ptr exception;
+
+        /** @name Detection of unchanged segments */
+        //@{
+        const ImageRegions* damage = nullptr; //!< Changed regions, if known
+        bool inPreviousFrame = false; //!< The Server has a copy of it
+        SegmentState previous;        //!< State in the previous frame
+        SegmentState state;           //!< State in the current frame
+        //@}
     };
-    static bool _isOnRightSideOfSideBySideImage(const SegmentTask& segment);
 
-    bool _generateJpeg(const ImageWrapper& image, const Handler& handler);
-    void _computeJpeg(SegmentTask& segment, bool sendSegment);
-    bool _generateRaw(const ImageWrapper& image, const Handler& handler) const;
+    void _schedule(JobPtr job, std::unique_lock<std::mutex>& lock);
+    void _launch(JobPtr job);
+    void _generateSegment(JobPtr job, SegmentTask& segment);
+    void _generateSegments(JobPtr job);
+    void _finishGeneration(JobPtr job);
+    bool _awaitConcurrentHandling(JobPtr job);
+    void _finishHandling(const Job& job, bool success);
+    void _release(Job& job);
+
+    void _encodeSegment(SegmentTask& segment);
+    void _encodeSkippedSegment(const Job& job, SegmentTask& segment);
+    void _computeJpeg(SegmentTask& segment);
+    void _computeLz4(SegmentTask& segment);
+    void _copyRaw(SegmentTask& segment);
+    bool _isUnchanged(SegmentTask& segment) const;
 
     using SegmentTasks = std::vector<SegmentTask>;
-    SegmentTasks _generateSegmentTasks(const ImageWrapper& image) const;
+    SegmentTasks _generateSegmentTasks(const ImageWrapper& image,
+                                       const QSize& segmentSize) const;
 
     using SegmentParametersList = std::vector<SegmentParameters>;
     SegmentParametersList _makeSegmentParameters(
-        const ImageWrapper& image) const;
-    SegmentationInfo _makeSegmentationInfo(const ImageWrapper& image) const;
+        const ImageWrapper& image, const QSize& segmentSize) const;
+    SegmentationInfo _makeSegmentationInfo(const ImageWrapper& image,
+                                           const QSize& segmentSize) const;
+    QSize _getSegmentSize(const ImageWrapper& image);
+
+    using SegmentKey =
+        std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, View, uint8_t>;
+    struct SegmentHistory
+    {
+        SegmentState state;
+        uint64_t frame = 0; //!< The last frame where the segment was generated
+    };
+    using History = std::map<SegmentKey, SegmentHistory>;
+
+    static SegmentKey _makeKey(const Segment& segment);
+    uint64_t _loadPreviousStates(SegmentTasks& segments,
+                                 const ImageRegions* damage, uint64_t frame);
+    void _storeStates(const SegmentTasks& segments, uint64_t frame,
+                      History& history);
 
     uint _nominalSegmentWidth = 0;
     uint _nominalSegmentHeight = 0;
 
-    MTQueue<SegmentTask> _sendQueue;
+    /** @name Adaptive segmentation */
+    //@{
+    bool _adaptiveSegmentation = false;
+    uint _segmentAlignment = 0;
+    uint _adaptiveSegmentSize = 0; // the current dimensions, 0 if unknown
+    std::atomic<size_t> _threadCount{0}; // of the executor, 0 if unknown
+    std::atomic<uint64_t> _encodingTime{0}; // nanoseconds
+    std::atomic<uint64_t> _encodedPixels{0};
+    std::mutex _segmentationMutex;
+    //@}
+
+    /** @name Pipelining of jobs */
+    //@{
+    size_t _pipelineDepth = 0;
+    size_t _pendingJobs = 0; // started but not handled yet
+    size_t _activeJobs = 0;  // scheduled but not generated yet
+    std::weak_ptr<Job> _lastJob; // the last scheduled job
+    Executor _executor;
+    bool _concurrentHandling = false;
+    mutable std::mutex _jobsMutex;
+    std::condition_variable _jobsCondition;
+    //@}
+
+    /** @name Detection of unchanged segments */
+    //@{
+    History _history;        // segments handled successfully
+    History _pendingHistory; // segments generated but not handled yet
+    uint64_t _discards = 0;  // number of times pending states were discarded
+    uint64_t _frame = 0;
+    std::mutex _historyMutex;
+    //@}
+
+    /** Recycled buffers for the image data of the segments */
+    BufferPool _buffers;
 };
 }
 #endif
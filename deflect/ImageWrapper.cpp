@@ -39,6 +39,8 @@
 
 #include "ImageWrapper.h"
 
+#include "PixelConverter.h"
+
 #include <cstring>
 
 #define DEFAULT_COMPRESSION_QUALITY 75
@@ -63,14 +65,33 @@ ImageWrapper::ImageWrapper(const void* data_, const unsigned int width_,
 
 unsigned int ImageWrapper::getBytesPerPixel() const
 {
-    // enum PixelFormat { RGB, RGBA, ARGB, BGR, BGRA, ABGR };
-    static const unsigned int bytesPerPixel[] = {3, 4, 4, 3, 4, 4};
+    // enum PixelFormat { RGB, RGBA, ARGB, BGR, BGRA, ABGR,
+    //                    YUV444, YUV422, YUV420 };
+    static const unsigned int bytesPerPixel[] = {3, 4, 4, 3, 4, 4, 1, 1, 1};
 
     return bytesPerPixel[pixelFormat];
 }
 
+size_t ImageWrapper::getPitch() const
+{
+    return pitch ? pitch : width * getBytesPerPixel();
+}
+
 size_t ImageWrapper::getBufferSize() const
 {
-    return width * height * getBytesPerPixel();
+    if (height == 0)
+        return 0;
+
+    if (!isPlanarYuv(pixelFormat))
+        return getPitch() * (height - 1) + width * getBytesPerPixel();
+
+    // The last row of the V plane ends the buffer
+    ImageRegion image;
+    image.width = width;
+    image.height = height;
+    const auto planes = getYuvPlanes(*this);
+    const auto lastPlane = planes.getPlaneRegion(2, image);
+    return planes.offset[2] + planes.pitch[2] * (lastPlane.height - 1) +
+           lastPlane.width;
 }
 }
@@ -49,6 +49,11 @@ namespace deflect
 /**
  *  The PixelFormat describes the organisation of the bytes in the image buffer.
  *  Formats are 8 bits per channel unless specified otherwise.
+ *
+ *  The planar YUV formats store the full Y plane followed by the U and V
+ *  planes, whose dimensions are rounded up when they are subsampled. The rows
+ *  of the Y plane are ImageWrapper::getPitch() bytes apart, those of the
+ *  subsampled planes half as much.
  *  @version 1.0
  */
 enum PixelFormat
@@ -58,15 +63,34 @@ enum PixelFormat
     ARGB,
     BGR,
     BGRA,
-    ABGR
+    ABGR,
+    YUV444, /**< Planar YUV, no subsampling. @version 1.1 */
+    YUV422, /**< Planar YUV, 50% horizontal subsampling. @version 1.1 */
+    YUV420  /**< Planar YUV (I420), 50% horizontal + vertical subsampling.
+                 @version 1.1 */
 };
 
 /** Image compression policy */
 enum CompressionPolicy
 {
-    COMPRESSION_AUTO, /**< Implementation specific */
-    COMPRESSION_ON,   /**< Force enable */
-    COMPRESSION_OFF   /**< Force disable */
+    COMPRESSION_AUTO,    /**< Implementation specific */
+    COMPRESSION_ON,      /**< Force enable */
+    COMPRESSION_OFF,     /**< Force disable */
+    COMPRESSION_LOSSLESS /**< Fast lossless compression (LZ4) @version 1.1 */
+};
+
+/**
+ * A rectangular region of an image, in pixels.
+ *
+ * The coordinates are relative to the first pixel of the image data buffer.
+ * @version 1.1
+ */
+struct ImageRegion
+{
+    unsigned int x = 0;      /**< The X coordinate. @version 1.1 */
+    unsigned int y = 0;      /**< The Y coordinate. @version 1.1 */
+    unsigned int width = 0;  /**< The width in pixels. @version 1.1 */
+    unsigned int height = 0; /**< The height in pixels. @version 1.1 */
 };
 
 /**
@@ -128,9 +152,33 @@ struct ImageWrapper
                                               100 best, default: 75).
                                               @version 1.0 */
     ChromaSubsampling subsampling;       /**< Chrominance sub-sampling.
-                                              (default: YUV444). @version 1.0 */
+                                              (default: YUV444, ignored for
+                                              planar YUV). @version 1.0 */
     //@}
 
+    /**
+     * Only send the segments which changed since the previous frame
+     * (default: false).
+     *
+     * A checksum of each segment is kept by the Stream and unchanged segments
+     * are skipped (no compression, no pixel data sent). The Server completes
+     * the frame with its last copy of the skipped tiles. This is most useful
+     * for mostly-static content where only small regions change every frame.
+     * @version 1.1
+     */
+    bool skipUnchangedSegments = false;
+
+    /**
+     * The number of bytes between the start of two consecutive rows of the
+     * data buffer (default: 0, for rows without padding).
+     *
+     * Use this to send images which have padded rows, such as aligned GL
+     * readbacks or QImage::bytesPerLine(), or a sub-region of a larger buffer
+     * without copying it first.
+     * @version 1.1
+     */
+    unsigned int pitch = 0;
+
     /**
      * The view that this image represents.
      * @version 1.0
@@ -160,12 +208,24 @@ struct ImageWrapper
 
     /**
      * Get the number of bytes per pixel based on the pixelFormat.
+     *
+     * For planar YUV formats this is the number of bytes per pixel of the Y
+     * plane.
      * @version 1.0
      */
     DEFLECT_API unsigned int getBytesPerPixel() const;
 
     /**
-     * Get the size of the data buffer in bytes: width*height*format.bpp.
+     * Get the number of bytes between the start of two consecutive rows.
+     * @return the pitch if it is set, width*format.bpp otherwise.
+     * @version 1.1
+     */
+    DEFLECT_API size_t getPitch() const;
+
+    /**
+     * Get the size of the data buffer in bytes, from the first pixel to the
+     * last one: pitch*(height-1) + width*format.bpp, plus the size of the U and
+     * V planes for planar YUV formats.
      * @version 1.0
      */
     DEFLECT_API size_t getBufferSize() const;
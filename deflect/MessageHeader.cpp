@@ -40,11 +40,14 @@
 #include "MessageHeader.h"
 
 #include <QDataStream>
+#include <QtEndian>
+
+#include <cstring>
 
 namespace deflect
 {
-const size_t MessageHeader::serializedSize =
-    sizeof(quint32) + sizeof(qint32) + MESSAGE_HEADER_URI_LENGTH;
+constexpr size_t MessageHeader::serializedSize;
+constexpr size_t MessageHeader::compactSerializedSize;
 
 MessageHeader::MessageHeader()
     : type(MESSAGE_TYPE_NONE)
@@ -64,25 +67,65 @@ MessageHeader::MessageHeader(const MessageType type_, const uint32_t size_,
     const size_t len = streamUri.copy(uri, MESSAGE_HEADER_URI_LENGTH - 1);
     uri[len] = '\0';
 }
+
+void MessageHeader::serialize(char* output) const
+{
+    const uint32_t fields[2] = {qToBigEndian(uint32_t(type)),
+                                qToBigEndian(size)};
+    std::memcpy(output, fields, sizeof(fields));
+    std::memcpy(output + sizeof(fields), uri, MESSAGE_HEADER_URI_LENGTH);
+}
+
+MessageHeader MessageHeader::deserialize(const char* input)
+{
+    uint32_t fields[2];
+    std::memcpy(fields, input, sizeof(fields));
+
+    MessageHeader header;
+    header.type = MessageType(int32_t(qFromBigEndian(fields[0])));
+    header.size = qFromBigEndian(fields[1]);
+    std::memcpy(header.uri, input + sizeof(fields), MESSAGE_HEADER_URI_LENGTH);
+    return header;
+}
+
+// Compact layout: type (1 byte), flags (1 byte, reserved), size (4 bytes)
+void MessageHeader::serializeCompact(char* output) const
+{
+    const uint32_t wireSize = qToBigEndian(size);
+    output[0] = char(type);
+    output[1] = 0;
+    std::memcpy(output + 2, &wireSize, sizeof(wireSize));
+}
+
+MessageHeader MessageHeader::deserializeCompact(const char* input)
+{
+    uint32_t wireSize;
+    std::memcpy(&wireSize, input + 2, sizeof(wireSize));
+
+    MessageHeader header;
+    header.type = MessageType(uint8_t(input[0]));
+    header.size = qFromBigEndian(wireSize);
+    return header;
+}
 } // namespace deflect
 
 QDataStream& operator<<(QDataStream& out, const deflect::MessageHeader& header)
 {
-    out << (qint32)header.type << (quint32)header.size;
-    out.writeRawData(header.uri, MESSAGE_HEADER_URI_LENGTH);
+    char buffer[deflect::MessageHeader::serializedSize];
+    header.serialize(buffer);
+    out.writeRawData(buffer, sizeof(buffer));
 
     return out;
 }
 
 QDataStream& operator>>(QDataStream& in, deflect::MessageHeader& header)
 {
-    qint32 type;
-    quint32 size;
-
-    in >> type;
-    header.type = (deflect::MessageType)type;
-    in >> size;
-    header.size = size;
-    in.readRawData(header.uri, MESSAGE_HEADER_URI_LENGTH);
+    char buffer[deflect::MessageHeader::serializedSize];
+    if (in.readRawData(buffer, sizeof(buffer)) != int(sizeof(buffer)))
+    {
+        in.setStatus(QDataStream::ReadPastEnd);
+        return in;
+    }
+    header = deflect::MessageHeader::deserialize(buffer);
     return in;
 }
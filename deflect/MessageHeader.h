@@ -70,7 +70,9 @@ enum MessageType
     MESSAGE_TYPE_IMAGE_VIEW = 15,
     MESSAGE_TYPE_OBSERVER_OPEN = 16,
     MESSAGE_TYPE_IMAGE_ROW_ORDER = 17,
-    MESSAGE_TYPE_IMAGE_CHANNEL = 18
+    MESSAGE_TYPE_IMAGE_CHANNEL = 18,
+    MESSAGE_TYPE_PIXELSTREAM_SEGMENT = 19,
+    MESSAGE_TYPE_PIXELSTREAM_SEGMENTS = 20
 };
 
 #define MESSAGE_HEADER_URI_LENGTH 64
@@ -97,8 +99,51 @@ struct MessageHeader
     DEFLECT_API MessageHeader(const MessageType type, const uint32_t size,
                               const std::string& streamUri = "");
 
-    /** The size of the QDataStream serialized output. */
-    static const size_t serializedSize;
+    /** The size of the serialized output. */
+    static constexpr size_t serializedSize =
+        2 * sizeof(uint32_t) + MESSAGE_HEADER_URI_LENGTH;
+
+    /**
+     * Serialize the header for network, in big-endian byte order.
+     *
+     * The output is identical to the QDataStream serialization, without the
+     * overhead of a QDataStream for each message.
+     *
+     * @param output the destination, of at least serializedSize bytes.
+     */
+    DEFLECT_API void serialize(char* output) const;
+
+    /**
+     * Deserialize a header from the network.
+     *
+     * @param input the serialized header, of serializedSize bytes.
+     * @return the deserialized header.
+     */
+    DEFLECT_API static MessageHeader deserialize(const char* input);
+
+    /**
+     * The size of the compact serialized output.
+     *
+     * Once a connection has opened its stream, the uri is implicit and the
+     * following messages from the client only carry the type and the size.
+     */
+    static constexpr size_t compactSerializedSize =
+        2 * sizeof(uint8_t) + sizeof(uint32_t);
+
+    /**
+     * Serialize the header without its uri, in big-endian byte order.
+     *
+     * @param output the destination, of at least compactSerializedSize bytes.
+     */
+    DEFLECT_API void serializeCompact(char* output) const;
+
+    /**
+     * Deserialize a compact header from the network.
+     *
+     * @param input the serialized header, of compactSerializedSize bytes.
+     * @return the deserialized header, with an empty uri.
+     */
+    DEFLECT_API static MessageHeader deserializeCompact(const char* input);
 };
 }
 
@@ -61,11 +61,14 @@ struct MetaTypeRegistration
         qRegisterMetaType<deflect::SizeHints>("deflect::SizeHints");
         qRegisterMetaType<deflect::Event>("deflect::Event");
         qRegisterMetaType<deflect::View>("deflect::View");
+        qRegisterMetaType<deflect::SocketMode>("deflect::SocketMode");
         qRegisterMetaType<deflect::server::BoolPromisePtr>(
             "deflect::server::BoolPromisePtr");
         qRegisterMetaType<deflect::server::FramePtr>(
             "deflect::server::FramePtr");
         qRegisterMetaType<deflect::server::Tile>("deflect::server::Tile");
+        qRegisterMetaType<deflect::server::TileQueuePtr>(
+            "deflect::server::TileQueuePtr");
     }
 };
 
@@ -39,7 +39,10 @@
 #ifndef DEFLECT_NETWORK_PROTOCOL_H
 #define DEFLECT_NETWORK_PROTOCOL_H
 
-#define NETWORK_PROTOCOL_VERSION 8
+#define NETWORK_PROTOCOL_VERSION 11
 #define DEFAULT_PORT_NUMBER 1701
 
+/** First version where clients send compact headers after the stream open. */
+#define NETWORK_PROTOCOL_COMPACT_HEADERS_VERSION 10
+
 #endif
@@ -0,0 +1,283 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "PixelConverter.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DEFLECT_PIXELCONVERTER_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DEFLECT_PIXELCONVERTER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace deflect
+{
+namespace
+{
+const uint8_t OPAQUE_ALPHA = 0xff; // source index for an opaque alpha channel
+
+/** How to build an RGBA pixel from a source pixel. */
+struct Swizzle
+{
+    size_t bytesPerPixel;
+    uint8_t index[4]; // source byte of each of the R, G, B, A channels
+};
+
+// enum PixelFormat { RGB, RGBA, ARGB, BGR, BGRA, ABGR };
+const Swizzle swizzles[] = {{3, {0, 1, 2, OPAQUE_ALPHA}},
+                            {4, {0, 1, 2, 3}},
+                            {4, {1, 2, 3, 0}},
+                            {3, {2, 1, 0, OPAQUE_ALPHA}},
+                            {4, {2, 1, 0, 3}},
+                            {4, {3, 2, 1, 0}}};
+
+void _convertScalar(const Swizzle& swizzle, const uint8_t* src, uint8_t* dst,
+                    const size_t count)
+{
+    for (size_t i = 0; i < count; ++i, src += swizzle.bytesPerPixel, dst += 4)
+    {
+        for (size_t c = 0; c < 4; ++c)
+        {
+            const auto index = swizzle.index[c];
+            dst[c] = index == OPAQUE_ALPHA ? 0xff : src[index];
+        }
+    }
+}
+
+#ifdef DEFLECT_PIXELCONVERTER_X86
+// Shuffle mask and alpha for 4 pixels in a 16 bytes register
+struct ShuffleMask
+{
+    uint8_t shuffle[16];
+    uint8_t alpha[16];
+
+    explicit ShuffleMask(const Swizzle& swizzle)
+    {
+        for (size_t p = 0; p < 4; ++p)
+        {
+            for (size_t c = 0; c < 4; ++c)
+            {
+                const auto index = swizzle.index[c];
+                const bool opaque = index == OPAQUE_ALPHA;
+                shuffle[p * 4 + c] =
+                    opaque ? 0x80 : uint8_t(p * swizzle.bytesPerPixel + index);
+                alpha[p * 4 + c] = opaque ? 0xff : 0;
+            }
+        }
+    }
+};
+
+__attribute__((target("ssse3"))) size_t _convertSSSE3(const Swizzle& swizzle,
+                                                       const uint8_t* src,
+                                                       uint8_t* dst,
+                                                       const size_t count)
+{
+    const ShuffleMask mask(swizzle);
+    const auto shuffle = _mm_loadu_si128((const __m128i*)mask.shuffle);
+    const auto alpha = _mm_loadu_si128((const __m128i*)mask.alpha);
+
+    // 4 pixels per iteration, reading 16 bytes
+    const auto bpp = swizzle.bytesPerPixel;
+    size_t i = 0;
+    for (; (count - i) * bpp >= 16; i += 4)
+    {
+        const auto in = _mm_loadu_si128((const __m128i*)(src + i * bpp));
+        const auto out = _mm_or_si128(_mm_shuffle_epi8(in, shuffle), alpha);
+        _mm_storeu_si128((__m128i*)(dst + i * 4), out);
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) size_t _convertAVX2(const Swizzle& swizzle,
+                                                     const uint8_t* src,
+                                                     uint8_t* dst,
+                                                     const size_t count)
+{
+    const ShuffleMask mask(swizzle);
+    const auto shuffle128 = _mm_loadu_si128((const __m128i*)mask.shuffle);
+    const auto alpha128 = _mm_loadu_si128((const __m128i*)mask.alpha);
+    const auto shuffle = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(shuffle128), shuffle128, 1);
+    const auto alpha =
+        _mm256_inserti128_si256(_mm256_castsi128_si256(alpha128), alpha128, 1);
+
+    // 8 pixels per iteration, 4 in each lane, reading 4 * bpp + 16 bytes
+    const auto bpp = swizzle.bytesPerPixel;
+    size_t i = 0;
+    for (; (count - i) * bpp >= 4 * bpp + 16; i += 8)
+    {
+        const auto pixels = src + i * bpp;
+        const auto in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)pixels)),
+            _mm_loadu_si128((const __m128i*)(pixels + 4 * bpp)), 1);
+        const auto out =
+            _mm256_or_si256(_mm256_shuffle_epi8(in, shuffle), alpha);
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), out);
+    }
+    return i;
+}
+
+using ConvertFunc = size_t (*)(const Swizzle&, const uint8_t*, uint8_t*,
+                               size_t);
+
+ConvertFunc _selectSimdConversion()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &_convertAVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return &_convertSSSE3;
+    return nullptr;
+}
+
+size_t _convertSimd(const Swizzle& swizzle, const uint8_t* src, uint8_t* dst,
+                    const size_t count)
+{
+    static const auto convert = _selectSimdConversion();
+    return convert ? convert(swizzle, src, dst, count) : 0;
+}
+#elif defined(DEFLECT_PIXELCONVERTER_NEON)
+template <typename Vector>
+uint8x16_t _getChannel(const Vector& in, const uint8_t index)
+{
+    return index == OPAQUE_ALPHA ? vdupq_n_u8(0xff) : in.val[index];
+}
+
+size_t _convertSimd(const Swizzle& swizzle, const uint8_t* src, uint8_t* dst,
+                    const size_t count)
+{
+    // 16 pixels per iteration
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        uint8x16x4_t out;
+        if (swizzle.bytesPerPixel == 3)
+        {
+            const auto in = vld3q_u8(src + i * 3);
+            for (size_t c = 0; c < 4; ++c)
+                out.val[c] = _getChannel(in, swizzle.index[c]);
+        }
+        else
+        {
+            const auto in = vld4q_u8(src + i * 4);
+            for (size_t c = 0; c < 4; ++c)
+                out.val[c] = _getChannel(in, swizzle.index[c]);
+        }
+        vst4q_u8(dst + i * 4, out);
+    }
+    return i;
+}
+#else
+size_t _convertSimd(const Swizzle&, const uint8_t*, uint8_t*, size_t)
+{
+    return 0;
+}
+#endif
+}
+
+void convertToRgba(const void* source, const PixelFormat format,
+                   void* destination, const size_t pixelCount)
+{
+    if (isPlanarYuv(format))
+        throw std::invalid_argument("cannot convert planar YUV to RGBA");
+
+    if (format == RGBA)
+    {
+        std::memcpy(destination, source, pixelCount * 4);
+        return;
+    }
+
+    const auto& swizzle = swizzles[format];
+    const auto src = static_cast<const uint8_t*>(source);
+    const auto dst = static_cast<uint8_t*>(destination);
+
+    const auto converted = _convertSimd(swizzle, src, dst, pixelCount);
+    _convertScalar(swizzle, src + converted * swizzle.bytesPerPixel,
+                   dst + converted * 4, pixelCount - converted);
+}
+
+bool isPlanarYuv(const PixelFormat format)
+{
+    return format == YUV444 || format == YUV422 || format == YUV420;
+}
+
+ImageRegion YuvPlanes::getPlaneRegion(const size_t plane,
+                                      const ImageRegion& region) const
+{
+    if (plane == 0)
+        return region;
+
+    // Subsampled dimensions are rounded up, like libjpeg-turbo does
+    ImageRegion planeRegion;
+    planeRegion.x = region.x >> shiftX;
+    planeRegion.y = region.y >> shiftY;
+    planeRegion.width = (region.width + (1u << shiftX) - 1) >> shiftX;
+    planeRegion.height = (region.height + (1u << shiftY) - 1) >> shiftY;
+    return planeRegion;
+}
+
+YuvPlanes getYuvPlanes(const ImageWrapper& image)
+{
+    if (!isPlanarYuv(image.pixelFormat))
+        throw std::invalid_argument("image is not in a planar YUV format");
+
+    YuvPlanes planes;
+    planes.shiftX = image.pixelFormat == YUV444 ? 0 : 1;
+    planes.shiftY = image.pixelFormat == YUV420 ? 1 : 0;
+
+    const auto lumaPitch = image.getPitch();
+    const auto chromaPitch = (lumaPitch + (1u << planes.shiftX) - 1) >>
+                             planes.shiftX;
+    const auto chromaHeight =
+        (image.height + (1u << planes.shiftY) - 1) >> planes.shiftY;
+
+    planes.offset[0] = 0;
+    planes.offset[1] = lumaPitch * image.height;
+    planes.offset[2] = planes.offset[1] + chromaPitch * chromaHeight;
+    planes.pitch[0] = lumaPitch;
+    planes.pitch[1] = chromaPitch;
+    planes.pitch[2] = chromaPitch;
+    return planes;
+}
+}
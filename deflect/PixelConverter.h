@@ -0,0 +1,88 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_PIXELCONVERTER_H
+#define DEFLECT_PIXELCONVERTER_H
+
+#include <deflect/ImageWrapper.h>
+#include <deflect/api.h>
+
+#include <cstddef>
+
+namespace deflect
+{
+/**
+ * Convert a row of pixels to RGBA.
+ *
+ * The conversion uses SIMD instructions (SSSE3, AVX2 or NEON) when they are
+ * available on the CPU. The alpha channel of RGB and BGR pixels is opaque.
+ *
+ * @param source the pixels to convert.
+ * @param format the packed pixel format of the source.
+ * @param destination the output buffer, of pixelCount * 4 bytes.
+ * @param pixelCount the number of pixels to convert.
+ * @throw std::invalid_argument if the format is planar YUV.
+ */
+DEFLECT_API void convertToRgba(const void* source, PixelFormat format,
+                               void* destination, size_t pixelCount);
+
+/** @return true if the format stores Y, U and V in separate planes. */
+DEFLECT_API bool isPlanarYuv(PixelFormat format);
+
+/** The memory layout of the planes of a planar YUV image. */
+struct YuvPlanes
+{
+    size_t offset[3];    // of the Y, U and V planes from the image data
+    size_t pitch[3];     // bytes between two rows of each plane
+    unsigned int shiftX; // horizontal chroma subsampling, as a bit shift
+    unsigned int shiftY; // vertical chroma subsampling, as a bit shift
+
+    /** Get the region of a plane which matches a region of the image. */
+    DEFLECT_API ImageRegion getPlaneRegion(size_t plane,
+                                           const ImageRegion& region) const;
+};
+
+/**
+ * Get the layout of the planes of a planar YUV image.
+ * @throw std::invalid_argument if the image is not in a planar YUV format.
+ */
+DEFLECT_API YuvPlanes getYuvPlanes(const ImageWrapper& image);
+}
+
+#endif
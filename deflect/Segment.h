@@ -52,13 +52,21 @@ namespace deflect
 struct Segment
 {
     SegmentParameters parameters;
+
+    /**
+     * The image data, empty if the segment is unchanged since the previous
+     * frame (the Server then reuses its last copy of the corresponding tile).
+     */
     QByteArray imageData;
 
-    /** Extra parameters sent separately for network protocol compatiblity. */
+    /** Extra parameters, sent inline with the SegmentParameters. */
 
     View view = View::mono;                 //!< Eye pass for the segment
     RowOrder rowOrder = RowOrder::top_down; //!< Row order of imageData
     uint8_t channel = 0;                    //!< Channel index for the segment
+
+    /** The Server keeps a copy of it, so it can be skipped in the next frame */
+    bool retained = false;
 };
 }
 
@@ -41,6 +41,7 @@
 #define DEFLECT_SEGMENTPARAMETERS_H
 
 #ifdef _WIN32
+typedef unsigned __int8 uint8_t;
 typedef unsigned __int32 uint32_t;
 #else
 #include <cstdint>
@@ -50,6 +51,19 @@ typedef unsigned __int32 uint32_t;
 
 namespace deflect
 {
+/**
+ * Flags of the SegmentParameters.
+ * @version 1.1
+ */
+enum SegmentFlags : uint8_t
+{
+    /** The rows of the segment data are in RowOrder::bottom_up. */
+    SEGMENT_BOTTOM_UP = 1 << 0,
+
+    /** The Server keeps a copy of the segment for the next frame. */
+    SEGMENT_RETAINED = 1 << 1
+};
+
 /**
  * Parameters for a Segment of an image.
  * @version 1.0
@@ -71,13 +85,28 @@ struct SegmentParameters
     /** Format in which the segment data is stored. */
     Format format = Format::jpeg;
 
+    /**
+     * @name Inline parameters
+     * Only used by MESSAGE_TYPE_PIXELSTREAM_SEGMENT messages, which carry the
+     * view, row order and channel of each segment in what used to be padding.
+     * @version 1.1
+     */
+    //@{
+    View view = View::mono; /**< The eye pass of the segment. */
+    uint8_t flags = 0;      /**< A combination of SegmentFlags. */
+    uint8_t channel = 0;    /**< The channel index of the segment. */
+    //@}
+
     /**
      * WARNING:
      * Extending this struct breaks compatibility with current
-     * NETWORK_PROTOCOL_VERSION == 8. This is due to the use of
+     * NETWORK_PROTOCOL_VERSION. This is due to the use of
      * sizeof(SegmentParameters) in (de)serialization code.
      */
 };
+
+static_assert(sizeof(SegmentParameters) == 20,
+              "SegmentParameters size is part of the network protocol");
 }
 
 #endif
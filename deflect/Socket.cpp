@@ -44,16 +44,86 @@
 #include "NetworkProtocol.h"
 
 #include <QCoreApplication>
-#include <QDataStream>
 #include <QLoggingCategory>
 #include <QTcpSocket>
+#include <QVariant>
 
 #include <sstream>
 
+#ifndef _WIN32
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
 namespace
 {
 const int INVALID_NETWORK_PROTOCOL_VERSION = -1;
 const int RECEIVE_TIMEOUT_MS = 1000;
+const int SEND_TIMEOUT_MS = 10000;
+
+const int THROUGHPUT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+bool _isProtocolStart(const deflect::MessageType type)
+{
+    return type == deflect::MESSAGE_TYPE_PIXELSTREAM_OPEN ||
+           type == deflect::MESSAGE_TYPE_OBSERVER_OPEN;
+}
+
+bool _isSegment(const deflect::MessageType type)
+{
+    return type == deflect::MESSAGE_TYPE_PIXELSTREAM ||
+           type == deflect::MESSAGE_TYPE_PIXELSTREAM_SEGMENT ||
+           type == deflect::MESSAGE_TYPE_PIXELSTREAM_SEGMENTS;
+}
+
+void _enlargeBuffer(QTcpSocket& socket,
+                    const QAbstractSocket::SocketOption option)
+{
+    if (socket.socketOption(option).toInt() < THROUGHPUT_BUFFER_SIZE)
+        socket.setSocketOption(option, THROUGHPUT_BUFFER_SIZE);
+}
+
+#ifndef _WIN32
+#ifdef IOV_MAX
+const size_t MAX_IOVECS = IOV_MAX;
+#else
+const size_t MAX_IOVECS = 16; // POSIX minimum
+#endif
+
+#if defined(TCP_CORK)
+#define CORK_OPTION TCP_CORK
+#elif defined(TCP_NOPUSH)
+#define CORK_OPTION TCP_NOPUSH // BSD and macOS equivalent
+#endif
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0; // Qt sets SO_NOSIGPIPE on its sockets instead
+#endif
+
+bool _waitUntilWritable(const int fd)
+{
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+
+    int ret = 0;
+    do
+    {
+        ret = ::poll(&pfd, 1, SEND_TIMEOUT_MS);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret > 0 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL));
+}
+#endif
 }
 
 namespace deflect
@@ -114,18 +184,54 @@ bool Socket::hasMessage(const size_t messageSize) const
 bool Socket::send(const MessageHeader& messageHeader, const QByteArray& message,
                   const bool waitForBytesWritten)
 {
+    return send(messageHeader, std::vector<QByteArray>{message},
+                waitForBytesWritten);
+}
+
+bool Socket::send(const MessageHeader& messageHeader,
+                  const std::vector<QByteArray>& parts,
+                  const bool waitForBytesWritten)
+{
+    std::lock_guard<TicketLock> ticket(_sendLock);
     QMutexLocker locker(&_socketMutex);
     if (!isConnected())
         return false;
 
-    // send header
-    QDataStream stream(_socket);
-    stream << messageHeader;
-    if (stream.status() != QDataStream::Ok)
-        return false;
-
-    // send message
-    const bool allSent = _write(message);
+    char headerData[MessageHeader::serializedSize];
+    size_t headerSize = MessageHeader::serializedSize;
+    if (_compactHeaders)
+    {
+        messageHeader.serializeCompact(headerData);
+        headerSize = MessageHeader::compactSerializedSize;
+    }
+    else
+        messageHeader.serialize(headerData);
+    const auto header = QByteArray::fromRawData(headerData, int(headerSize));
+
+    std::vector<const QByteArray*> buffers;
+    buffers.reserve(parts.size() + 1);
+    buffers.push_back(&header);
+    for (const auto& part : parts)
+        buffers.push_back(&part);
+
+    // Segments are held back until the next other message, usually the end
+    // of the frame, so that they leave in full packets
+    const bool isSegment = _isSegment(messageHeader.type);
+    if (_mode == SocketMode::throughput && isSegment)
+        _setCorked(true);
+
+    // send header and message
+    const bool allSent = _writeVectored(buffers);
+
+    if (_corked && !isSegment)
+        _setCorked(false);
+
+    // The stream id is known to the Server from now on
+    if (allSent && _isProtocolStart(messageHeader.type) &&
+        _serverProtocolVersion >= NETWORK_PROTOCOL_COMPACT_HEADERS_VERSION)
+    {
+        _compactHeaders = true;
+    }
 
     if (waitForBytesWritten)
     {
@@ -137,6 +243,34 @@ bool Socket::send(const MessageHeader& messageHeader, const QByteArray& message,
     return allSent;
 }
 
+bool Socket::canSendFromAnyThread()
+{
+#ifdef _WIN32
+    return false; // messages are written through the QTcpSocket
+#else
+    return true;
+#endif
+}
+
+void Socket::setMode(const SocketMode mode)
+{
+    QMutexLocker locker(&_socketMutex);
+    _setCorked(false);
+    _mode = mode;
+    applyMode(*_socket, mode);
+}
+
+void Socket::applyMode(QTcpSocket& socket, const SocketMode mode)
+{
+    socket.setSocketOption(QAbstractSocket::LowDelayOption,
+                           mode == SocketMode::low_latency ? 1 : 0);
+    if (mode == SocketMode::throughput)
+    {
+        _enlargeBuffer(socket, QAbstractSocket::SendBufferSizeSocketOption);
+        _enlargeBuffer(socket, QAbstractSocket::ReceiveBufferSizeSocketOption);
+    }
+}
+
 bool Socket::receive(MessageHeader& messageHeader, QByteArray& message)
 {
     QMutexLocker locker(&_socketMutex);
@@ -175,10 +309,12 @@ bool Socket::_receiveHeader(MessageHeader& messageHeader)
             return false;
     }
 
-    QDataStream stream(_socket);
-    stream >> messageHeader;
+    char buffer[MessageHeader::serializedSize];
+    if (_socket->read(buffer, sizeof(buffer)) != qint64(sizeof(buffer)))
+        return false;
 
-    return stream.status() == QDataStream::Ok;
+    messageHeader = MessageHeader::deserialize(buffer);
+    return true;
 }
 
 void Socket::_connect(const std::string& host, const unsigned short port)
@@ -218,6 +354,24 @@ bool Socket::_receiveProtocolVersion()
     return true;
 }
 
+void Socket::_setCorked(const bool corked)
+{
+#ifdef CORK_OPTION
+    if (corked == _corked)
+        return;
+
+    // Removing the cork sends the pending partial packet immediately
+    const int value = corked ? 1 : 0;
+    if (::setsockopt(getFileDescriptor(), IPPROTO_TCP, CORK_OPTION, &value,
+                     sizeof(value)) == 0)
+    {
+        _corked = corked;
+    }
+#else
+    Q_UNUSED(corked);
+#endif
+}
+
 bool Socket::_write(const QByteArray& message)
 {
     bool allSent = true;
@@ -236,4 +390,67 @@ bool Socket::_write(const QByteArray& message)
     }
     return allSent;
 }
+
+#ifdef _WIN32
+bool Socket::_writeVectored(const std::vector<const QByteArray*>& buffers)
+{
+    for (const auto buffer : buffers)
+    {
+        if (!_write(*buffer))
+            return false;
+    }
+    return true;
+}
+#else
+bool Socket::_writeVectored(const std::vector<const QByteArray*>& buffers)
+{
+    // Nothing is written through the QTcpSocket, which must not be used from
+    // the other threads calling send()
+    std::vector<iovec> iovecs;
+    iovecs.reserve(buffers.size());
+    for (const auto buffer : buffers)
+    {
+        if (!buffer->isEmpty())
+            iovecs.push_back({const_cast<char*>(buffer->constData()),
+                              size_t(buffer->size())});
+    }
+
+    const int fd = getFileDescriptor();
+    size_t current = 0;
+    while (current < iovecs.size())
+    {
+        msghdr msg{};
+        msg.msg_iov = &iovecs[current];
+        msg.msg_iovlen = std::min(iovecs.size() - current, MAX_IOVECS);
+
+        const ssize_t sent = ::sendmsg(fd, &msg, SEND_FLAGS);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (_waitUntilWritable(fd))
+                    continue;
+
+                // The message is incomplete, so the stream can not go on
+                ::shutdown(fd, SHUT_RDWR);
+            }
+            return false;
+        }
+
+        // skip the buffers sent entirely, then adjust the partially sent one
+        auto remaining = size_t(sent);
+        while (current < iovecs.size() && remaining >= iovecs[current].iov_len)
+            remaining -= iovecs[current++].iov_len;
+        if (remaining > 0)
+        {
+            auto& iov = iovecs[current];
+            iov.iov_base = (char*)iov.iov_base + remaining;
+            iov.iov_len -= remaining;
+        }
+    }
+    return true;
+}
+#endif
 }
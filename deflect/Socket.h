@@ -45,10 +45,12 @@
 typedef __int32 int32_t;
 #endif
 
+#include <deflect/TicketLock.h>
 #include <deflect/api.h>
 #include <deflect/types.h>
 
 #include <string>
+#include <vector>
 
 #include <QByteArray>
 #include <QMutex>
@@ -113,6 +115,55 @@ public:
     bool send(const MessageHeader& messageHeader, const QByteArray& message,
               bool waitForBytesWritten);
 
+    /**
+     * Send a message made of several parts, without concatenating them.
+     *
+     * The messages following a successful stream (or observer) open message
+     * are sent with compact headers, which the Server recognizes from the
+     * protocol version announced in the open message.
+     *
+     * Where supported, the header and the parts are handed to the kernel with
+     * a single vectored write, so the data of the parts is never copied.
+     * Such messages bypass the QTcpSocket, so they can be sent from any thread
+     * if waitForBytesWritten is false. Concurrent calls are served in order by
+     * a ticket lock held until the whole message is written, while the other
+     * senders sleep. A message which can not be written within a timeout
+     * closes the connection.
+     *
+     * @param messageHeader The message header, its size must be the sum of the
+     *        sizes of the parts
+     * @param parts The message data, in order
+     * @param waitForBytesWritten see send()
+     * @return true if the message could be sent, false otherwise
+     */
+    bool send(const MessageHeader& messageHeader,
+              const std::vector<QByteArray>& parts, bool waitForBytesWritten);
+
+    /** @return true if send() can be called from any thread. */
+    static bool canSendFromAnyThread();
+
+    /**
+     * Tune this socket for the given mode.
+     *
+     * In throughput mode, the messages of the segments are held back until
+     * they fill complete packets, and pushed out by the next other message
+     * (typically the end of the frame), where the platform supports it.
+     *
+     * @param mode the mode to apply to this socket.
+     */
+    void setMode(SocketMode mode);
+
+    /**
+     * Apply the options of a mode to a TCP socket.
+     *
+     * The buffers are only ever enlarged, so going back to the standard mode
+     * only re-enables Nagle's algorithm.
+     *
+     * @param socket the socket to tune.
+     * @param mode the mode to apply.
+     */
+    DEFLECT_API static void applyMode(QTcpSocket& socket, SocketMode mode);
+
     /**
      * Receive a message.
      * @param messageHeader The received message header
@@ -129,12 +180,18 @@ private:
     const std::string _host;
     QTcpSocket* _socket; // Child QObject
     mutable QMutex _socketMutex;
+    TicketLock _sendLock; // frames the messages of concurrent senders
     int32_t _serverProtocolVersion;
+    bool _compactHeaders = false; // once the stream is open
+    SocketMode _mode = SocketMode::standard;
+    bool _corked = false;
 
     bool _receiveHeader(MessageHeader& messageHeader);
     void _connect(const std::string& host, const unsigned short port);
     bool _receiveProtocolVersion();
+    void _setCorked(bool corked);
     bool _write(const QByteArray& data);
+    bool _writeVectored(const std::vector<const QByteArray*>& buffers);
 };
 }
 
@@ -69,6 +69,12 @@ Stream::Future Stream::send(const ImageWrapper& image)
     return _impl->sendImage(image, false);
 }
 
+Stream::Future Stream::send(const ImageWrapper& image,
+                            const ImageRegions& damage)
+{
+    return _impl->sendImage(image, false, &damage);
+}
+
 Stream::Future Stream::finishFrame()
 {
     return _impl->sendFinishFrame();
@@ -78,4 +84,55 @@ Stream::Future Stream::sendAndFinish(const ImageWrapper& image)
 {
     return _impl->sendImage(image, true);
 }
+
+Stream::Future Stream::sendAndFinish(const ImageWrapper& image,
+                                     const ImageRegions& damage)
+{
+    return _impl->sendImage(image, true, &damage);
+}
+
+void Stream::setPipelineDepth(const unsigned int depth)
+{
+    _impl->_imageSegmenter.setPipelineDepth(depth);
+}
+
+void Stream::setAdaptiveSegmentation(const bool enable,
+                                     const unsigned int alignment)
+{
+    _impl->_imageSegmenter.setAdaptiveSegmentation(enable, alignment);
+}
+
+void Stream::setCompressionThreads(const unsigned int threadCount,
+                                   const std::vector<unsigned int>& cpus)
+{
+    _impl->setCompressionThreads(threadCount, cpus);
+}
+
+void Stream::setCompressionNumaNode(const unsigned int threadCount,
+                                    const unsigned int node)
+{
+    _impl->setCompressionThreads(threadCount,
+                                 ThreadPool::getNumaNodeCpus(node));
+}
+
+void Stream::setCompressionExecutor(Executor executor)
+{
+    _impl->setCompressionExecutor(std::move(executor));
+}
+
+void Stream::setParallelSending(const bool enable)
+{
+    _impl->_imageSegmenter.setConcurrentHandling(
+        enable && Socket::canSendFromAnyThread());
+}
+
+void Stream::setConnectionCount(const unsigned int count)
+{
+    _impl->setConnectionCount(count);
+}
+
+void Stream::setSocketMode(const SocketMode mode)
+{
+    _impl->setSocketMode(mode);
+}
 }
@@ -47,6 +47,9 @@
 #include <deflect/api.h>
 #include <deflect/types.h>
 
+#include <functional>
+#include <vector>
+
 namespace deflect
 {
 /**
@@ -124,10 +127,14 @@ public:
     /**
      * Send an image asynchronously.
      *
+     * Uncompressed images which are not RGBA are converted to RGBA while they
+     * are segmented, except planar YUV images which are sent as they are.
+     *
      * @param image The image to send. Note that the image is not copied, so the
      *              referenced must remain valid until the send is finished.
      * @return true if the image data could be sent, false otherwise
-     * @throw std::invalid_argument if not RGBA and uncompressed
+     * @throw std::invalid_argument if the image pitch is smaller than a row
+     * @throw std::invalid_argument if planar YUV and lossless compression
      * @throw std::invalid_argument if invalid JPEG compression arguments
      * @throw std::runtime_error if pending finishFrame() has not been completed
      * @throw std::runtime_error if JPEG compression failed
@@ -136,6 +143,34 @@ public:
      */
     DEFLECT_API Future send(const ImageWrapper& image);
 
+    /**
+     * Send the damaged regions of an image asynchronously.
+     *
+     * Only the segments which intersect the damaged regions are compressed
+     * and sent, the Server reuses its copy of the other segments from the
+     * previous frame. This is more efficient than
+     * ImageWrapper::skipUnchangedSegments when the application already knows
+     * which parts of the image changed, as no pixel comparison is needed.
+     *
+     * The first frame and any segment which was not sent in the previous frame
+     * are always sent entirely, regardless of the damage.
+     *
+     * @param image The image to send, see send().
+     * @param damage The regions of the image which changed since the previous
+     *        frame, in pixels relative to the first pixel of the image data.
+     *        An empty list means that the image did not change.
+     * @return true if the image data could be sent, false otherwise
+     * @throw std::invalid_argument if the image pitch is smaller than a row
+     * @throw std::invalid_argument if planar YUV and lossless compression
+     * @throw std::invalid_argument if invalid JPEG compression arguments
+     * @throw std::runtime_error if pending finishFrame() has not been completed
+     * @throw std::runtime_error if JPEG compression failed
+     * @version 1.1
+     * @sa send()
+     */
+    DEFLECT_API Future send(const ImageWrapper& image,
+                            const ImageRegions& damage);
+
     /**
      * Asynchronously notify that all the images for this frame have been sent.
      *
@@ -160,7 +195,8 @@ public:
      * @param image The image to send. Note that the image is not copied, so the
      *              referenced must remain valid until the send is finished
      * @return true if the image data could be sent, false otherwise.
-     * @throw std::invalid_argument if RGBA and uncompressed
+     * @throw std::invalid_argument if the image pitch is smaller than a row
+     * @throw std::invalid_argument if planar YUV and lossless compression
      * @throw std::invalid_argument if invalid JPEG compression arguments
      * @throw std::runtime_error if pending finishFrame() has not been completed
      * @throw std::runtime_error if JPEG compression failed
@@ -168,6 +204,155 @@ public:
      * @version 1.0
      */
     DEFLECT_API Future sendAndFinish(const ImageWrapper& image);
+
+    /**
+     * Send the damaged regions of an image and finish the frame asynchronously.
+     *
+     * @param image The image to send, see sendAndFinish().
+     * @param damage The regions of the image which changed since the previous
+     *        frame, see send(const ImageWrapper&, const ImageRegions&).
+     * @return true if the image data could be sent, false otherwise.
+     * @throw std::invalid_argument if the image pitch is smaller than a row
+     * @throw std::invalid_argument if planar YUV and lossless compression
+     * @throw std::invalid_argument if invalid JPEG compression arguments
+     * @throw std::runtime_error if pending finishFrame() has not been completed
+     * @throw std::runtime_error if JPEG compression failed
+     * @version 1.1
+     */
+    DEFLECT_API Future sendAndFinish(const ImageWrapper& image,
+                                     const ImageRegions& damage);
+
+    /**
+     * Set the number of images which can be compressed ahead of the network.
+     *
+     * By default, the compression of an image only starts once the previous
+     * images have been sent. With a depth > 0, the compression starts in send()
+     * and overlaps the transmission of the previous images. The images are
+     * still sent in order. send() blocks when the given number of images are
+     * already being compressed or sent.
+     *
+     * @param depth the maximum number of images in flight (default: 0).
+     * @version 1.1
+     */
+    DEFLECT_API void setPipelineDepth(unsigned int depth);
+
+    /**
+     * Select the dimensions of the image segments automatically.
+     *
+     * By default, images are split in segments of 512x512 pixels. In adaptive
+     * mode, the dimensions are chosen for each image from its size, the number
+     * of compression threads and the compression time measured on the previous
+     * segments. Small images are then split enough to use all the threads,
+     * while large images are not split in a multitude of small messages.
+     *
+     * @param enable use adaptive segment dimensions (default: false).
+     * @param alignment if non-zero, the segment dimensions are a multiple of
+     *        it, for instance to align the segments with the tiles of the
+     *        display wall.
+     * @version 1.1
+     */
+    DEFLECT_API void setAdaptiveSegmentation(bool enable,
+                                             unsigned int alignment = 0);
+    //@}
+
+    /** @name Compression threads */
+    //@{
+    /** Function executing a task asynchronously. @version 1.1 */
+    using Executor = std::function<void(std::function<void()>)>;
+
+    /**
+     * Compress the images with a pool of threads dedicated to this Stream.
+     *
+     * By default, the images are compressed by the global QThreadPool which is
+     * shared with the rest of the application.
+     *
+     * @param threadCount the number of threads, 0 for as many threads as CPUs
+     *        (given or available).
+     * @param cpus optional list of CPUs to bind the threads to, to keep the
+     *        compression away from the rendering threads (Linux only).
+     * @version 1.1
+     */
+    DEFLECT_API void setCompressionThreads(
+        unsigned int threadCount,
+        const std::vector<unsigned int>& cpus = std::vector<unsigned int>());
+
+    /**
+     * Compress the images with threads bound to the CPUs of a NUMA node.
+     *
+     * @param threadCount the number of threads, 0 for one per CPU of the node.
+     * @param node the index of the NUMA node.
+     * @throw std::runtime_error if the node does not exist or if the platform
+     *        is not supported (only Linux is).
+     * @version 1.1
+     * @sa setCompressionThreads()
+     */
+    DEFLECT_API void setCompressionNumaNode(unsigned int threadCount,
+                                            unsigned int node);
+
+    /**
+     * Compress the images with an external executor.
+     *
+     * This allows the compression to run in the thread pool of the application
+     * (TBB, OpenMP...) instead of competing with it.
+     *
+     * @param executor the function executing the compression tasks, which must
+     *        execute all the tasks it receives; nullptr to use the global
+     *        QThreadPool again.
+     * @version 1.1
+     */
+    DEFLECT_API void setCompressionExecutor(Executor executor);
+    //@}
+
+    /** @name Network connections */
+    //@{
+    /**
+     * Let the compression threads send the segments they have compressed.
+     *
+     * By default, all the segments are handed to the single thread which owns
+     * the socket, which can become the bottleneck with many compression
+     * threads. When enabled, each compression thread writes its segments
+     * directly to the socket. This has no effect on the images which are
+     * started ahead of the previous ones (see setPipelineDepth()), and is not
+     * available on Windows.
+     *
+     * @param enable send from the compression threads (default: false).
+     * @version 1.1
+     */
+    DEFLECT_API void setParallelSending(bool enable);
+
+    /**
+     * Send the segments of the images through several connections.
+     *
+     * A single TCP connection can not saturate fast network links. The
+     * additional connections are opened immediately, and the segments are
+     * distributed among all of them, always sending a segment at a given
+     * position through the same one. The Server merges them back into a single
+     * stream, like the ones of several sources. Each additional connection
+     * is written by its own thread.
+     *
+     * This must not be called while images are being sent. Connections can
+     * be removed at any time, after which the next images are sent in full.
+     *
+     * @param count the number of connections (default: 1).
+     * @throw std::runtime_error if connections are added after a frame was
+     *        finished, or if a new connection could not be established.
+     * @version 1.1
+     */
+    DEFLECT_API void setConnectionCount(unsigned int count);
+
+    /**
+     * Tune the network connections of the stream.
+     *
+     * The low latency mode sends every message immediately, for interactive
+     * streams of small images. The throughput mode enlarges the socket
+     * buffers and sends the segments of a frame in full packets, pushed out
+     * when the frame is finished, for streams of large images. Buffers which
+     * were enlarged are kept when switching modes.
+     *
+     * @param mode the socket mode (default: SocketMode::standard).
+     * @version 1.1
+     */
+    DEFLECT_API void setSocketMode(SocketMode mode);
     //@}
 
 private:
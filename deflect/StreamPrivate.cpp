@@ -45,6 +45,7 @@
 
 #include <QHostInfo>
 
+#include <algorithm>
 #include <sstream>
 #include <stdexcept>
 
@@ -55,6 +56,7 @@ const char* STREAM_HOST_ENV_VAR = "DEFLECT_HOST";
 
 const unsigned int SEGMENT_SIZE = 512;
 const unsigned int SMALL_IMAGE_SIZE = 64;
+const size_t MAX_BATCH_SIZE = 64 * 1024;
 
 std::string _getStreamHost(const std::string& host)
 {
@@ -111,11 +113,12 @@ namespace
 {
 void _checkParameters(const ImageWrapper& image)
 {
-    if (image.compressionPolicy != COMPRESSION_ON && image.pixelFormat != RGBA)
+    if (image.pitch && image.pitch < image.width * image.getBytesPerPixel())
     {
-        throw std::invalid_argument(
-            "Currently, RAW images can only be sent in RGBA format. Other "
-            "formats support remain to be implemented.");
+        std::stringstream msg;
+        msg << "Image pitch must be at least width * bytes per pixel, got "
+            << image.pitch << std::endl;
+        throw std::invalid_argument(msg.str());
     }
 
     if (image.compressionPolicy == COMPRESSION_ON)
@@ -134,6 +137,36 @@ bool _canSendAsSingleSegment(const ImageWrapper& image)
 {
     return image.width <= SMALL_IMAGE_SIZE && image.height <= SMALL_IMAGE_SIZE;
 }
+
+// The server completes the unchanged segments of a connection from the
+// previous frame of the same connection, so a segment must always go through
+// the same one. Striping the grid of segments diagonally also balances them.
+size_t _getConnectionIndex(const Segment& segment, const size_t count)
+{
+    const auto& params = segment.parameters;
+    const size_t column = params.width ? params.x / params.width : 0;
+    const size_t row = params.height ? params.y / params.height : 0;
+    return (column + row + size_t(segment.view) + segment.channel) % count;
+}
+}
+
+StreamPrivate::Connection::Connection(StreamPrivate& stream)
+    : socket{stream.socket.getHost(), stream.socket.getPort()}
+    , sendWorker{socket, stream.id}
+    , task{&sendWorker, &stream}
+{
+    socket.moveToThread(&sendWorker);
+    sendWorker.start();
+    sendWorker.enqueueRequest(task.openStream()).wait();
+    const auto mode = stream._socketMode;
+    if (mode != SocketMode::standard)
+        sendWorker.enqueueRequest(task.setSocketMode(mode)).wait();
+}
+
+StreamPrivate::Connection::~Connection()
+{
+    if (socket.isConnected())
+        sendWorker.enqueueRequest(task.close()).wait();
 }
 
 StreamPrivate::StreamPrivate(const std::string& id_, const std::string& host,
@@ -161,6 +194,8 @@ StreamPrivate::StreamPrivate(const std::string& id_, const std::string& host,
 
 StreamPrivate::~StreamPrivate()
 {
+    _extraConnections.clear();
+
     if (socket.isConnected())
         sendWorker.enqueueRequest(task.close()).wait();
 }
@@ -181,7 +216,8 @@ Stream::Future StreamPrivate::send(QByteArray&& data)
 }
 
 Stream::Future StreamPrivate::sendImage(const ImageWrapper& image,
-                                        const bool finish)
+                                        const bool finish,
+                                        const ImageRegions* damage)
 {
     try
     {
@@ -194,16 +230,30 @@ Stream::Future StreamPrivate::sendImage(const ImageWrapper& image,
         {
             // OPT for OSPRay-KNL with external thread pool - compress directly
             // in caller thread.
-            auto segment = _imageSegmenter.createSingleSegment(image);
+            auto segment = _imageSegmenter.createSingleSegment(image, damage);
             // As we expect to encounter a lot of these small sends, be
             // optimistic and fulfill the promise already to reduce load in the
-            // send thread (c.f. lock ops performance on KNL).
-            sendWorker.enqueueFastRequest(task.send(std::move(segment)));
+            // send thread (c.f. lock ops performance on KNL). The segments are
+            // also batched to save a message header and a syscall for each.
+            _addToBatch(std::move(segment));
             return finish ? sendFinishFrame() : make_ready_future(true);
         }
 
+        _flushBatch();
+
+        auto job = _imageSegmenter.createJob(image, damage);
+        if (finish)
+        {
+            _frameFinished = true;
+            _imageSegmenter.finishFrame();
+        }
+
+        // Compress ahead of the send thread if pipelining is enabled
+        if (_imageSegmenter.getPipelineDepth() > 0)
+            _imageSegmenter.start(job);
+
         return sendWorker.enqueueRequest(
-            task.sendUsingMTCompression(image, _imageSegmenter, finish));
+            task.sendUsingMTCompression(job, _imageSegmenter, finish));
     }
     catch (...)
     {
@@ -213,13 +263,196 @@ Stream::Future StreamPrivate::sendImage(const ImageWrapper& image,
 
 Stream::Future StreamPrivate::sendFinishFrame()
 {
+    _flushBatch();
+
     _pendingFinish = true;
+    _frameFinished = true;
+    _imageSegmenter.finishFrame();
     return sendWorker.enqueueRequest(task.finishFrame(), true);
 }
 
+void StreamPrivate::setCompressionThreads(const unsigned int threadCount,
+                                          const std::vector<unsigned int>& cpus)
+{
+    auto pool = std::make_unique<ThreadPool>(threadCount, cpus);
+    auto poolPtr = pool.get();
+    _imageSegmenter.setExecutor(
+        [poolPtr](std::function<void()> function) {
+            poolPtr->execute(std::move(function));
+        },
+        pool->getThreadCount());
+    // the previous pool is no longer in use
+    _compressionPool = std::move(pool);
+}
+
+void StreamPrivate::setCompressionExecutor(ImageSegmenter::Executor executor)
+{
+    _imageSegmenter.setExecutor(std::move(executor));
+    _compressionPool.reset();
+}
+
+void StreamPrivate::setConnectionCount(const unsigned int count)
+{
+    const size_t extraCount = count > 1 ? count - 1 : 0;
+    if (extraCount > _extraConnections.size() && _frameFinished)
+        throw std::runtime_error(
+            "Connections can only be added before the first frame");
+
+    if (extraCount == _extraConnections.size())
+        return;
+
+    while (_extraConnections.size() > extraCount)
+        _extraConnections.pop_back();
+    while (_extraConnections.size() < extraCount)
+        _extraConnections.emplace_back(std::make_unique<Connection>(*this));
+
+    // The segments are now striped differently, so the connections may not
+    // have the previous segments to complete the unchanged ones
+    _imageSegmenter.resetHistory();
+}
+
+void StreamPrivate::_addToBatch(Segment&& segment)
+{
+    std::lock_guard<std::mutex> lock(_batchMutex);
+    _batchSize += sizeof(SegmentParameters) + segment.imageData.size();
+    _batch.emplace_back(std::move(segment));
+    if (_batchSize < MAX_BATCH_SIZE)
+        return;
+
+    sendWorker.enqueueFastRequest(task.send(std::move(_batch)));
+    _batch.clear();
+    _batchSize = 0;
+}
+
+void StreamPrivate::_flushBatch()
+{
+    std::lock_guard<std::mutex> lock(_batchMutex);
+    if (_batch.empty())
+        return;
+
+    sendWorker.enqueueFastRequest(task.send(std::move(_batch)));
+    _batch.clear();
+    _batchSize = 0;
+}
+
+void StreamPrivate::setSocketMode(const SocketMode mode)
+{
+    // The sockets are configured by the threads which own them
+    _socketMode = mode;
+    sendWorker.enqueueRequest(task.setSocketMode(mode)).wait();
+    for (auto& connection : _extraConnections)
+    {
+        auto& worker = connection->sendWorker;
+        worker.enqueueRequest(connection->task.setSocketMode(mode)).wait();
+    }
+}
+
 bool StreamPrivate::_finishFrameDone()
 {
     _pendingFinish = false;
     return true;
 }
+
+bool StreamPrivate::_sendSegment(const Segment& segment)
+{
+    const auto index =
+        _getConnectionIndex(segment, _extraConnections.size() + 1);
+    if (index == 0)
+        return sendWorker._sendSegment(segment);
+
+    // The failures are reported when the frame is finished
+    _enqueueSegments(*_extraConnections[index - 1], {segment});
+    return true;
+}
+
+bool StreamPrivate::_sendSegments(std::vector<Segment>& segments)
+{
+    if (_extraConnections.empty())
+        return sendWorker._sendSegments(segments.data(), segments.size());
+
+    // Group the segments by connection, to send one message to each
+    const auto count = _extraConnections.size() + 1;
+    std::stable_sort(segments.begin(), segments.end(),
+                     [count](const Segment& a, const Segment& b) {
+                         return _getConnectionIndex(a, count) <
+                                _getConnectionIndex(b, count);
+                     });
+
+    bool success = true;
+    auto begin = segments.begin();
+    while (begin != segments.end())
+    {
+        const auto index = _getConnectionIndex(*begin, count);
+        const auto end = std::find_if(begin, segments.end(),
+                                      [index, count](const Segment& segment) {
+                                          return _getConnectionIndex(
+                                                     segment, count) != index;
+                                      });
+        if (index == 0)
+        {
+            if (!sendWorker._sendSegments(&(*begin), size_t(end - begin)))
+                success = false;
+        }
+        else
+        {
+            _enqueueSegments(*_extraConnections[index - 1],
+                             {std::make_move_iterator(begin),
+                              std::make_move_iterator(end)});
+        }
+        begin = end;
+    }
+    return success;
+}
+
+bool StreamPrivate::_sendFinish()
+{
+    // Finish the frame on every connection even if one of them failed, so
+    // that the finish is no longer pending
+    std::vector<Stream::Future> finished;
+    finished.reserve(_extraConnections.size());
+    for (auto& connection : _extraConnections)
+        finished.emplace_back(_enqueueFinish(*connection));
+
+    bool success = sendWorker._sendFinish();
+    for (auto& future : finished)
+    {
+        try
+        {
+            if (!future.get())
+                success = false;
+        }
+        catch (...)
+        {
+            success = false;
+        }
+    }
+    return _finishFrameDone() && success;
+}
+
+void StreamPrivate::_enqueueSegments(Connection& connection,
+                                     std::vector<Segment>&& segments)
+{
+    auto send = [this, &connection, segments = std::move(segments)]() mutable {
+        auto& worker = connection.sendWorker;
+        if (!worker._sendSegments(segments.data(), segments.size()))
+            connection.failed = true;
+        for (auto& segment : segments)
+            _imageSegmenter.recycle(std::move(segment.imageData));
+        return true;
+    };
+    connection.sendWorker.enqueueFastRequest(std::move(send));
+}
+
+Stream::Future StreamPrivate::_enqueueFinish(Connection& connection)
+{
+    // The finish is processed once all the queued segments have been sent
+    auto finish = [this, &connection]() {
+        const bool segmentsSent = !connection.failed.exchange(false);
+        // The Server may lack any of the segments of this connection
+        if (!segmentsSent)
+            _imageSegmenter.resetHistory();
+        return connection.sendWorker._sendFinish() && segmentsSent;
+    };
+    return connection.sendWorker.enqueueRequest(std::move(finish), true);
+}
 }
@@ -46,9 +46,13 @@
 #include "Socket.h"           // member
 #include "StreamSendWorker.h" // member
 #include "TaskBuilder.h"      // member
+#include "ThreadPool.h"       // member
 
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace deflect
 {
@@ -90,20 +94,80 @@ public:
     /** Prepare tasks for the sendWorker. */
     TaskBuilder task;
 
+    /** Optional dedicated threads for the compression of images. */
+    std::unique_ptr<ThreadPool> _compressionPool;
+
     /** The segmenter for doing multithreaded image segmentation + send. */
     ImageSegmenter _imageSegmenter;
 
     /** Remember a pending finishFrame where no sendImage() is allowed. */
     std::atomic_bool _pendingFinish{false};
 
+    /** Remember if a frame was finished, after which no connection is added */
+    std::atomic_bool _frameFinished{false};
+
+    /**
+     * An additional connection of the stream, to send segments in parallel.
+     * Its socket is only written by its own sendWorker.
+     */
+    struct Connection
+    {
+        explicit Connection(StreamPrivate& stream);
+        ~Connection();
+
+        Socket socket;
+        StreamSendWorker sendWorker;
+        TaskBuilder task;
+
+        /** A segment of the current frame could not be sent. */
+        std::atomic_bool failed{false};
+    };
+    std::vector<std::unique_ptr<Connection>> _extraConnections;
+
+    /** The tuning of the sockets, also applied to new connections. */
+    SocketMode _socketMode = SocketMode::standard;
+
+    /** Small segments of the current frame, to be sent in one message. */
+    std::mutex _batchMutex;
+    std::vector<Segment> _batch;
+    size_t _batchSize = 0;
+
     Stream::Future bindEvents(bool exclusive);
     Stream::Future send(const SizeHints& hints);
     Stream::Future send(QByteArray&& data);
-    Stream::Future sendImage(const ImageWrapper& image, bool finish);
+    Stream::Future sendImage(const ImageWrapper& image, bool finish,
+                             const ImageRegions* damage = nullptr);
     Stream::Future sendFinishFrame();
+    void setCompressionThreads(unsigned int threadCount,
+                               const std::vector<unsigned int>& cpus);
+    void setCompressionExecutor(ImageSegmenter::Executor executor);
+    void setConnectionCount(unsigned int count);
+    void setSocketMode(SocketMode mode);
+
+    /** Add a small segment to the batch, sent once it is big enough. */
+    void _addToBatch(Segment&& segment);
+
+    /** Send the pending batch of small segments. */
+    void _flushBatch();
 
     /** @internal Called by StreamSendWorker when finishFrame was processed. */
     bool _finishFrameDone();
+
+    /** @internal Send a segment through the connection assigned to it. */
+    bool _sendSegment(const Segment& segment);
+
+    /** @internal Send segments in one message per connection. */
+    bool _sendSegments(std::vector<Segment>& segments);
+
+    /** @internal Finish the frame on all the connections. */
+    bool _sendFinish();
+
+    /** Hand segments over to the send thread of an additional connection. */
+    void _enqueueSegments(Connection& connection,
+                          std::vector<Segment>&& segments);
+
+    /** Finish the frame on an additional connection, in its send thread. */
+    Stream::Future _enqueueFinish(Connection& connection);
 };
 }
 #endif
@@ -44,10 +44,27 @@
 #include "Segment.h"
 #include "SizeHints.h"
 
+#include <cstring>
 #include <iostream>
 
 namespace deflect
 {
+namespace
+{
+SegmentParameters _getInlineParameters(const Segment& segment)
+{
+    auto params = segment.parameters;
+    params.view = segment.view;
+    params.flags = 0;
+    if (segment.rowOrder == RowOrder::bottom_up)
+        params.flags |= SEGMENT_BOTTOM_UP;
+    if (segment.retained)
+        params.flags |= SEGMENT_RETAINED;
+    params.channel = segment.channel;
+    return params;
+}
+}
+
 StreamSendWorker::StreamSendWorker(Socket& socket, const std::string& id)
     : _socket(socket)
     , _id(id)
@@ -192,59 +209,42 @@ bool StreamSendWorker::_sendClose()
 
 bool StreamSendWorker::_sendSegment(const Segment& segment)
 {
-    if (segment.view != _currentView)
-    {
-        if (!_sendImageView(segment.view))
-            return false;
-        _currentView = segment.view;
-    }
-    _sendRowOrderIfChanged(segment.rowOrder);
-    _sendImageChannelIfChanged(segment.channel);
-
-    auto message = QByteArray{(const char*)(&segment.parameters),
-                              sizeof(SegmentParameters)};
-    message.append(segment.imageData);
-    return _send(MESSAGE_TYPE_PIXELSTREAM, message, false);
-}
-
-bool StreamSendWorker::_sendImageView(const View view)
-{
-    return _send(MESSAGE_TYPE_IMAGE_VIEW,
-                 QByteArray{(const char*)(&view), sizeof(View)});
-}
-
-bool StreamSendWorker::_sendRowOrderIfChanged(const RowOrder rowOrder)
-{
-    if (rowOrder != _currentRowOrder)
-    {
-        if (!_sendImageRowOrder(rowOrder))
-            return false;
-        _currentRowOrder = rowOrder;
-    }
-    return true;
-}
-
-bool StreamSendWorker::_sendImageRowOrder(const RowOrder rowOrder)
-{
-    return _send(MESSAGE_TYPE_IMAGE_ROW_ORDER,
-                 QByteArray{(const char*)(&rowOrder), sizeof(RowOrder)});
+    const auto params = _getInlineParameters(segment);
+
+    // The parameters and the image data are sent without copying them
+    const auto parameters =
+        QByteArray::fromRawData((const char*)(&params),
+                                sizeof(SegmentParameters));
+    return _sendParts(MESSAGE_TYPE_PIXELSTREAM_SEGMENT,
+                      {parameters, segment.imageData}, false);
 }
 
-bool StreamSendWorker::_sendImageChannelIfChanged(const uint8_t channel)
+bool StreamSendWorker::_sendSegments(const Segment* segments,
+                                     const size_t count)
 {
-    if (channel != _currentChannel)
+    // Each segment is prefixed by its size and its parameters, which are
+    // gathered in one buffer. The image data is sent without copying it.
+    const size_t prefixSize = sizeof(uint32_t) + sizeof(SegmentParameters);
+    QByteArray prefixes(int(count * prefixSize), Qt::Uninitialized);
+
+    std::vector<QByteArray> parts;
+    parts.reserve(2 * count);
+    for (size_t i = 0; i < count; ++i)
     {
-        if (!_sendImageChannel(channel))
-            return false;
-        _currentChannel = channel;
+        const auto& segment = segments[i];
+        const auto params = _getInlineParameters(segment);
+        const uint32_t size =
+            sizeof(SegmentParameters) + uint32_t(segment.imageData.size());
+
+        const auto prefix = prefixes.data() + i * prefixSize;
+        std::memcpy(prefix, &size, sizeof(uint32_t));
+        std::memcpy(prefix + sizeof(uint32_t), &params,
+                    sizeof(SegmentParameters));
+
+        parts.push_back(QByteArray::fromRawData(prefix, int(prefixSize)));
+        parts.push_back(segment.imageData);
     }
-    return true;
-}
-
-bool StreamSendWorker::_sendImageChannel(const uint8_t channel)
-{
-    return _send(MESSAGE_TYPE_IMAGE_CHANNEL,
-                 QByteArray{(const char*)(&channel), sizeof(uint8_t)});
+    return _sendParts(MESSAGE_TYPE_PIXELSTREAM_SEGMENTS, parts, false);
 }
 
 bool StreamSendWorker::_sendFinish()
@@ -270,10 +270,27 @@ bool StreamSendWorker::_sendBindEvents(const bool exclusive)
                  {});
 }
 
+bool StreamSendWorker::_setSocketMode(const SocketMode mode)
+{
+    _socket.setMode(mode);
+    return true;
+}
+
 bool StreamSendWorker::_send(const MessageType type, const QByteArray& message,
                              const bool waitForBytesWritten)
 {
     return _socket.send(MessageHeader(type, message.size(), _id), message,
                         waitForBytesWritten);
 }
+
+bool StreamSendWorker::_sendParts(const MessageType type,
+                                  const std::vector<QByteArray>& parts,
+                                  const bool waitForBytesWritten)
+{
+    uint32_t size = 0;
+    for (const auto& part : parts)
+        size += part.size();
+    return _socket.send(MessageHeader(type, size, _id), parts,
+                        waitForBytesWritten);
+}
 }
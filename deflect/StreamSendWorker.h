@@ -68,6 +68,11 @@ using Task = std::function<bool()>;
  * "QSocketNotifier: Socket notifiers cannot be enabled or disabled from another
  * thread".
  * To avoid it, the Socket must be moved to the worker thread (moveToThread()).
+ *
+ * Segments are the exception: the Socket writes them to its native descriptor,
+ * so _sendSegment() may also be called concurrently by the compression threads.
+ * Each segment is a single message, which the Socket keeps intact by serving
+ * the threads in turn.
  */
 class StreamSendWorker : public QThread
 {
@@ -104,9 +109,6 @@ private:
 
     moodycamel::BlockingConcurrentQueue<Request> _requests;
     std::atomic_bool _running{false};
-    View _currentView = View::mono;
-    RowOrder _currentRowOrder = RowOrder::top_down;
-    uint8_t _currentChannel = 0;
 
     std::vector<Request> _dequeuedRequests;
     bool _pendingFinish = false;
@@ -119,24 +121,24 @@ private:
     void run() final;
 
     friend class deflect::test::Application; // to send pre-compressed segments
+    friend class StreamPrivate; // to stripe segments across connections
     friend class TaskBuilder;
 
     bool _sendOpenObserver();
     bool _sendOpenStream();
     bool _sendClose();
     bool _sendSegment(const Segment& segment);
-    bool _sendImageView(View view);
-    bool _sendRowOrderIfChanged(RowOrder rowOrder);
-    bool _sendImageRowOrder(RowOrder rowOrder);
-    bool _sendImageChannelIfChanged(uint8_t channel);
-    bool _sendImageChannel(uint8_t channel);
+    bool _sendSegments(const Segment* segments, size_t count);
     bool _sendFinish();
     bool _sendData(const QByteArray data);
     bool _sendSizeHints(const SizeHints& hints);
     bool _sendBindEvents(const bool exclusive);
+    bool _setSocketMode(SocketMode mode);
 
     bool _send(MessageType type, const QByteArray& message,
                bool waitForBytesWritten = true);
+    bool _sendParts(MessageType type, const std::vector<QByteArray>& parts,
+                    bool waitForBytesWritten);
 };
 }
 #endif
@@ -39,7 +39,6 @@
 
 #include "TaskBuilder.h"
 
-#include "ImageSegmenter.h"
 #include "SizeHints.h"
 #include "StreamPrivate.h"
 
@@ -71,6 +70,11 @@ Task TaskBuilder::bindEvents(const bool exclusive)
     return std::bind(&StreamSendWorker::_sendBindEvents, _worker, exclusive);
 }
 
+Task TaskBuilder::setSocketMode(const SocketMode mode)
+{
+    return std::bind(&StreamSendWorker::_setSocketMode, _worker, mode);
+}
+
 Task TaskBuilder::send(const SizeHints& hints)
 {
     return std::bind(&StreamSendWorker::_sendSizeHints, _worker, hints);
@@ -82,11 +86,11 @@ Task TaskBuilder::send(const QByteArray& data)
 }
 
 std::vector<Task> TaskBuilder::sendUsingMTCompression(
-    const ImageWrapper& image, ImageSegmenter& imageSegmenter,
+    ImageSegmenter::JobPtr job, ImageSegmenter& imageSegmenter,
     const bool finish)
 {
     std::vector<Task> tasks;
-    tasks.emplace_back(send(image, imageSegmenter));
+    tasks.emplace_back(send(job, imageSegmenter));
     if (finish)
     {
         auto finishTasks = finishFrame();
@@ -99,23 +103,28 @@ std::vector<Task> TaskBuilder::sendUsingMTCompression(
 std::vector<Task> TaskBuilder::finishFrame()
 {
     std::vector<Task> tasks;
-    tasks.emplace_back(std::bind(&StreamSendWorker::_sendFinish, _worker));
-    tasks.emplace_back(std::bind(&StreamPrivate::_finishFrameDone, _stream));
+    tasks.emplace_back(std::bind(&StreamPrivate::_sendFinish, _stream));
     return tasks;
 }
 
-Task TaskBuilder::send(Segment&& segment)
+Task TaskBuilder::send(std::vector<Segment>&& segments)
 {
-    return std::bind(&StreamSendWorker::_sendSegment, _worker, segment);
+    auto stream = _stream;
+    return [stream, segments = std::move(segments)]() mutable {
+        const bool result = stream->_sendSegments(segments);
+        for (auto& segment : segments)
+            stream->_imageSegmenter.recycle(std::move(segment.imageData));
+        return result;
+    };
 }
 
-Task TaskBuilder::send(const ImageWrapper& image,
+Task TaskBuilder::send(ImageSegmenter::JobPtr job,
                        ImageSegmenter& imageSegmenter)
 {
-    auto sendFunc = std::bind(&StreamSendWorker::_sendSegment, _worker,
+    auto sendFunc = std::bind(&StreamPrivate::_sendSegment, _stream,
                               std::placeholders::_1);
-    return [&imageSegmenter, image, sendFunc]() {
-        return imageSegmenter.generate(image, sendFunc);
+    return [&imageSegmenter, job, sendFunc]() {
+        return imageSegmenter.handle(job, sendFunc);
     };
 }
 }
@@ -40,6 +40,7 @@
 #ifndef DEFLECT_TASKBUILDER_H
 #define DEFLECT_TASKBUILDER_H
 
+#include "ImageSegmenter.h"
 #include "StreamSendWorker.h"
 #include "types.h"
 
@@ -57,11 +58,12 @@ public:
     Task openObserver();
     Task bindEvents(bool exclusive);
     Task close();
+    Task setSocketMode(SocketMode mode);
 
     Task send(const SizeHints& hints);
     Task send(const QByteArray& data);
-    Task send(Segment&& segment);
-    std::vector<Task> sendUsingMTCompression(const ImageWrapper& image,
+    Task send(std::vector<Segment>&& segments);
+    std::vector<Task> sendUsingMTCompression(ImageSegmenter::JobPtr job,
                                              ImageSegmenter& imageSegmenter,
                                              bool finish);
     std::vector<Task> finishFrame();
@@ -70,7 +72,7 @@ private:
     StreamSendWorker* _worker = nullptr;
     StreamPrivate* _stream = nullptr;
 
-    Task send(const ImageWrapper& image, ImageSegmenter& imageSegmenter);
+    Task send(ImageSegmenter::JobPtr job, ImageSegmenter& imageSegmenter);
 };
 }
 
@@ -0,0 +1,153 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace deflect
+{
+namespace
+{
+void _setAffinity(const std::vector<unsigned int>& cpus)
+{
+#ifdef __linux__
+    if (cpus.empty())
+        return;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (const auto cpu : cpus)
+        CPU_SET(cpu, &cpuSet);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+#else
+    (void)cpus;
+#endif
+}
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount,
+                       const std::vector<unsigned int>& cpus)
+{
+    if (threadCount == 0)
+        threadCount = cpus.empty() ? std::thread::hardware_concurrency()
+                                   : cpus.size();
+
+    for (unsigned int i = 0; i < std::max(threadCount, 1u); ++i)
+        _threads.emplace_back(&ThreadPool::_run, this, cpus);
+}
+
+ThreadPool::~ThreadPool()
+{
+    // an empty function stops one thread after the pending ones are executed
+    for (size_t i = 0; i < _threads.size(); ++i)
+        _functions.enqueue(std::function<void()>());
+
+    for (auto& thread : _threads)
+        thread.join();
+}
+
+void ThreadPool::execute(std::function<void()> function)
+{
+    _functions.enqueue(function);
+}
+
+size_t ThreadPool::getThreadCount() const
+{
+    return _threads.size();
+}
+
+std::vector<unsigned int> ThreadPool::getNumaNodeCpus(const unsigned int node)
+{
+#ifdef __linux__
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) +
+                       "/cpulist");
+    std::string cpuList;
+    if (!std::getline(file, cpuList))
+        throw std::runtime_error("NUMA node " + std::to_string(node) +
+                                 " not found");
+
+    const auto cpus = parseCpuList(cpuList);
+    if (cpus.empty())
+        throw std::runtime_error("NUMA node " + std::to_string(node) +
+                                 " has no CPUs");
+    return cpus;
+#else
+    (void)node;
+    throw std::runtime_error("NUMA nodes are only supported on Linux");
+#endif
+}
+
+std::vector<unsigned int> ThreadPool::parseCpuList(const std::string& cpuList)
+{
+    std::vector<unsigned int> cpus;
+    std::stringstream stream(cpuList);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        if (range.empty())
+            continue;
+
+        const auto dash = range.find('-');
+        const auto first = std::stoul(range.substr(0, dash));
+        const auto last = dash == std::string::npos
+                              ? first
+                              : std::stoul(range.substr(dash + 1));
+        for (auto cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+void ThreadPool::_run(const std::vector<unsigned int>& cpus)
+{
+    _setAffinity(cpus);
+
+    while (auto function = _functions.dequeue())
+        function();
+}
+}
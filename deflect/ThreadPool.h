@@ -0,0 +1,108 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_THREADPOOL_H
+#define DEFLECT_THREADPOOL_H
+
+#include <deflect/api.h>
+
+#include "MTQueue.h"
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace deflect
+{
+/**
+ * A fixed-size pool of threads executing functions in FIFO order.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * Start the threads of the pool.
+     *
+     * @param threadCount the number of threads, 0 for as many threads as CPUs
+     *        (given or available).
+     * @param cpus optional list of CPUs to bind the threads to (Linux only).
+     */
+    DEFLECT_API ThreadPool(unsigned int threadCount,
+                           const std::vector<unsigned int>& cpus);
+
+    /** Stop the threads, once all pending functions have been executed. */
+    DEFLECT_API ~ThreadPool();
+
+    /** Execute a function in one of the threads of the pool. @threadsafe */
+    DEFLECT_API void execute(std::function<void()> function);
+
+    /** @return the number of threads of the pool. */
+    DEFLECT_API size_t getThreadCount() const;
+
+    /**
+     * Get the CPUs of a NUMA node.
+     *
+     * @param node the index of the NUMA node.
+     * @return the list of CPUs of the node.
+     * @throw std::runtime_error if the node does not exist or the platform is
+     *        not supported (only Linux is).
+     */
+    DEFLECT_API static std::vector<unsigned int> getNumaNodeCpus(
+        unsigned int node);
+
+    /**
+     * Parse a Linux list of CPUs, for instance "0-3,8,10-11".
+     *
+     * @param cpuList the comma-separated list of CPUs and ranges of CPUs.
+     * @return the CPUs of the list, ranges expanded.
+     * @throw std::invalid_argument if the list is malformed.
+     */
+    DEFLECT_API static std::vector<unsigned int> parseCpuList(
+        const std::string& cpuList);
+
+private:
+    MTQueue<std::function<void()>> _functions;
+    std::vector<std::thread> _threads;
+
+    void _run(const std::vector<unsigned int>& cpus);
+};
+}
+
+#endif
@@ -41,6 +41,7 @@
 
 #include "Frame.h"
 #include "ReceiveBuffer.h"
+#include "TileQueue.h"
 
 #include <cassert>
 
@@ -127,10 +128,25 @@ void FrameDispatcher::removeSource(const QString uri, const size_t sourceIndex)
     if (!_impl->streams.count(uri))
         return;
 
-    _impl->streams[uri].buffer.removeSource(sourceIndex);
+    auto& buffer = _impl->streams[uri].buffer;
+    buffer.removeSource(sourceIndex);
 
     if (_impl->allConnectionsClosed(uri))
+    {
         deleteStream(uri);
+        return;
+    }
+
+    // The frame may only have been waiting for the removed source
+    try
+    {
+        if (buffer.isAllowedToSend() && buffer.hasCompleteFrame())
+            emit sendFrame(_impl->consumeLatestFrame(uri));
+    }
+    catch (const std::runtime_error& e)
+    {
+        emit pixelStreamError(uri, e.what());
+    }
 }
 
 void FrameDispatcher::addObserver(const QString uri)
@@ -181,6 +197,22 @@ void FrameDispatcher::processFrameFinished(const QString uri,
     }
 }
 
+void FrameDispatcher::processQueuedFrame(const QString uri,
+                                         const size_t sourceIndex,
+                                         TileQueuePtr tiles)
+{
+    // The frame is popped even for a closed stream, to keep the queue in sync
+    const auto frameTiles = tiles->popFrame();
+    if (!_impl->streams.count(uri))
+        return;
+
+    auto& buffer = _impl->streams[uri].buffer;
+    for (const auto& tile : frameTiles)
+        buffer.insert(tile, sourceIndex);
+
+    processFrameFinished(uri, sourceIndex);
+}
+
 void FrameDispatcher::requestFrame(const QString uri)
 {
     if (!_impl->streams.count(uri))
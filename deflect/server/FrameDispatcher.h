@@ -42,6 +42,7 @@
 
 #include <deflect/api.h>
 #include <deflect/server/Tile.h>
+#include <deflect/server/types.h>
 
 #include <QObject>
 #include <map>
@@ -115,6 +116,19 @@ public slots:
      */
     void processFrameFinished(QString uri, size_t sourceIndex);
 
+    /**
+     * Process the Tiles of a finished frame received through a queue.
+     *
+     * This replaces a processTile() call for each tile followed by a
+     * processFrameFinished().
+     *
+     * @param uri Identifier for the stream
+     * @param sourceIndex Identifier for the source in the stream
+     * @param tiles the queue of the source, which contains the finished frame
+     */
+    void processQueuedFrame(QString uri, size_t sourceIndex,
+                            deflect::server::TileQueuePtr tiles);
+
     /**
      * Request the dispatching of a new frame for any stream (mono/stereo).
      *
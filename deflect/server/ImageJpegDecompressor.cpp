@@ -99,13 +99,21 @@ JpegHeader ImageJpegDecompressor::decompressHeader(const QByteArray& jpegData)
 }
 
 QByteArray ImageJpegDecompressor::decompress(const QByteArray& jpegData)
+{
+    QByteArray decodedData;
+    decompress(jpegData, decodedData);
+    return decodedData;
+}
+
+void ImageJpegDecompressor::decompress(const QByteArray& jpegData,
+                                       QByteArray& decodedData)
 {
     const auto header = decompressHeader(jpegData);
     const int pixelFormat = TJPF_RGBX; // Format for OpenGL texture (GL_RGBA)
     const int pitch = header.width * tjPixelSize[pixelFormat];
     const int flags = TJ_FASTUPSAMPLE;
 
-    QByteArray decodedData(header.height * pitch, Qt::Uninitialized);
+    decodedData.resize(header.height * pitch);
 
     int err = tjDecompress2(_tjHandle, (unsigned char*)jpegData.data(),
                             (unsigned long)jpegData.size(),
@@ -113,14 +121,20 @@ QByteArray ImageJpegDecompressor::decompress(const QByteArray& jpegData)
                             pitch, header.height, pixelFormat, flags);
     if (err != 0)
         throw std::runtime_error("libjpeg-turbo image decompression failed");
-
-    return decodedData;
 }
 
 #ifndef DEFLECT_USE_LEGACY_LIBJPEGTURBO
 
 ImageJpegDecompressor::YUVData ImageJpegDecompressor::decompressToYUV(
     const QByteArray& jpegData)
+{
+    QByteArray decodedData;
+    const auto subsampling = decompressToYUV(jpegData, decodedData);
+    return std::make_pair(std::move(decodedData), subsampling);
+}
+
+ChromaSubsampling ImageJpegDecompressor::decompressToYUV(
+    const QByteArray& jpegData, QByteArray& decodedData)
 {
     const auto header = decompressHeader(jpegData);
     const int pad = 1; // no padding
@@ -129,7 +143,7 @@ ImageJpegDecompressor::YUVData ImageJpegDecompressor::decompressToYUV(
     const auto decodedSize =
         tjBufSizeYUV2(header.width, pad, header.height, jpegSubsamp);
 
-    auto decodedData = QByteArray(decodedSize, Qt::Uninitialized);
+    decodedData.resize(int(decodedSize));
 
     int err = tjDecompressToYUV2(_tjHandle, (unsigned char*)jpegData.data(),
                                  (unsigned long)jpegData.size(),
@@ -138,7 +152,7 @@ ImageJpegDecompressor::YUVData ImageJpegDecompressor::decompressToYUV(
     if (err != 0)
         throw std::runtime_error("libjpeg-turbo image decompression failed");
 
-    return std::make_pair(std::move(decodedData), header.subsampling);
+    return header.subsampling;
 }
 
 #endif
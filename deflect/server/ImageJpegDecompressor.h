@@ -89,6 +89,18 @@ public:
      */
     DEFLECT_API QByteArray decompress(const QByteArray& jpegData);
 
+    /**
+     * Decompress a Jpeg image into a given buffer.
+     *
+     * @param jpegData The compressed Jpeg data
+     * @param decodedData The buffer which receives the decompressed image data
+     *        in (GL_)RGBA format, resized as needed. Its memory is reused if
+     *        its capacity is sufficient.
+     * @throw std::runtime_error if a decompression error occured
+     */
+    DEFLECT_API void decompress(const QByteArray& jpegData,
+                                QByteArray& decodedData);
+
 #ifndef DEFLECT_USE_LEGACY_LIBJPEGTURBO
 
     using YUVData = std::pair<QByteArray, ChromaSubsampling>;
@@ -102,6 +114,18 @@ public:
      */
     DEFLECT_API YUVData decompressToYUV(const QByteArray& jpegData);
 
+    /**
+     * Decompress a Jpeg image to YUV into a given buffer.
+     *
+     * @param jpegData The compressed Jpeg data
+     * @param decodedData The buffer which receives the decompressed image data
+     *        in YUV format, resized as needed.
+     * @return The chroma subsampling of the decompressed image
+     * @throw std::runtime_error if a decompression error occured
+     */
+    DEFLECT_API ChromaSubsampling decompressToYUV(const QByteArray& jpegData,
+                                                  QByteArray& decodedData);
+
 #endif
 
 private:
@@ -48,22 +48,63 @@
 #include <QtNetwork/QNetworkProxy>
 #include <QtNetwork/QTcpServer>
 
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 namespace deflect
 {
 namespace server
 {
+namespace
+{
+Qt::ConnectionType _connectionType(const QObject& object)
+{
+    return QThread::currentThread() == object.thread()
+               ? Qt::DirectConnection
+               : Qt::BlockingQueuedConnection;
+}
+
+// Invoke a slot by its name, which is only checked at run time. The functor
+// overload of QMetaObject::invokeMethod() would need Qt 5.10.
+template <typename... Args>
+void _invoke(QObject* object, const char* slot, const Qt::ConnectionType type,
+             Args&&... args)
+{
+    if (!QMetaObject::invokeMethod(object, slot, type,
+                                   std::forward<Args>(args)...))
+    {
+        qCritical("deflect::server::Server: could not invoke %s", slot);
+        Q_ASSERT(false);
+    }
+}
+}
+
 const int Server::defaultPortNumber = DEFAULT_PORT_NUMBER;
 
 class Server::Impl : public QTcpServer
 {
 public:
-    Impl(const int port, Server* parent_)
+    Impl(const int port, const unsigned int dispatcherThreads,
+         Server* parent_)
         : QTcpServer(parent_)
         , server{parent_}
-        , frameDispatcher{new FrameDispatcher{parent_}}
     {
+        if (dispatcherThreads == 0)
+            dispatchers.push_back(new FrameDispatcher{parent_});
+
+        for (unsigned int i = 0; i < dispatcherThreads; ++i)
+        {
+            auto dispatcher = new FrameDispatcher;
+            auto dispatcherThread = new QThread(this);
+            dispatcher->moveToThread(dispatcherThread);
+            connect(dispatcherThread, &QThread::finished, dispatcher,
+                    &FrameDispatcher::deleteLater);
+            dispatcherThread->start();
+            dispatchers.push_back(dispatcher);
+            dispatchingThreads.push_back(dispatcherThread);
+        }
+
         setProxy(QNetworkProxy::NoProxy);
         if (!listen(QHostAddress::Any, port))
         {
@@ -77,14 +118,28 @@ public:
 
     ~Impl()
     {
+        // The workers use the dispatchers until their threads have finished
         for (auto child : children())
         {
-            if (auto workerThread = qobject_cast<QThread*>(child))
+            auto workerThread = qobject_cast<QThread*>(child);
+            if (workerThread &&
+                std::find(dispatchingThreads.begin(),
+                          dispatchingThreads.end(),
+                          workerThread) == dispatchingThreads.end())
             {
                 workerThread->quit();
                 workerThread->wait();
             }
         }
+
+        // The threaded dispatchers are deleted when their thread finishes
+        for (auto dispatcherThread : dispatchingThreads)
+        {
+            dispatcherThread->quit();
+            dispatcherThread->wait();
+        }
+        if (!dispatchingThreads.empty())
+            dispatchers.clear();
     }
 
     /** Re-implemented handling of connections from QTCPSocket. */
@@ -92,20 +147,7 @@ public:
     {
         try
         {
-            auto worker = new ServerWorker(socketHandle);
-            auto workerThread = new QThread(this);
-            worker->moveToThread(workerThread);
-
-            connect(workerThread, &QThread::started, worker,
-                    &ServerWorker::initConnection);
-            connect(worker, &ServerWorker::connectionClosed, workerThread,
-                    &QThread::quit);
-
-            // Make sure the thread will be deleted
-            connect(workerThread, &QThread::finished, worker,
-                    &ServerWorker::deleteLater);
-            connect(workerThread, &QThread::finished, workerThread,
-                    &QThread::deleteLater);
+            auto worker = new ServerWorker(socketHandle, socketMode);
 
             // public signals/slots, forwarding from/to worker
             connect(worker, &ServerWorker::registerToEvents, server,
@@ -119,23 +161,43 @@ public:
             connect(server, &Server::_closePixelStream, worker,
                     &ServerWorker::closeConnections);
 
-            // FrameDispatcher
-            connect(worker, &ServerWorker::addStreamSource, frameDispatcher,
-                    &FrameDispatcher::addSource);
-            connect(frameDispatcher, &FrameDispatcher::sourceRejected, worker,
-                    &ServerWorker::closeConnection);
-            connect(worker, &ServerWorker::receivedTile, frameDispatcher,
-                    &FrameDispatcher::processTile);
-            connect(worker, &ServerWorker::receivedFrameFinished,
-                    frameDispatcher, &FrameDispatcher::processFrameFinished);
-            connect(worker, &ServerWorker::removeStreamSource, frameDispatcher,
-                    &FrameDispatcher::removeSource);
-            connect(worker, &ServerWorker::addObserver, frameDispatcher,
-                    &FrameDispatcher::addObserver);
-            connect(worker, &ServerWorker::removeObserver, frameDispatcher,
-                    &FrameDispatcher::removeObserver);
-
-            workerThread->start();
+            // FrameDispatcher of the stream, known from the first message
+            for (auto dispatcher : dispatchers)
+            {
+                connect(dispatcher, &FrameDispatcher::sourceRejected, worker,
+                        &ServerWorker::closeConnection);
+            }
+            connect(worker, &ServerWorker::addStreamSource, worker,
+                    [this](const QString uri, const size_t sourceIndex) {
+                        invoke(uri, "addSource", Q_ARG(QString, uri),
+                               Q_ARG(size_t, sourceIndex));
+                    });
+            connect(worker, &ServerWorker::receivedFrameFinished, worker,
+                    [this](const QString uri, const size_t sourceIndex,
+                           const TileQueuePtr tiles) {
+                        invoke(uri, "processQueuedFrame", Q_ARG(QString, uri),
+                               Q_ARG(size_t, sourceIndex),
+                               Q_ARG(deflect::server::TileQueuePtr, tiles));
+                    });
+            connect(worker, &ServerWorker::removeStreamSource, worker,
+                    [this](const QString uri, const size_t sourceIndex) {
+                        invoke(uri, "removeSource", Q_ARG(QString, uri),
+                               Q_ARG(size_t, sourceIndex));
+                    });
+            connect(worker, &ServerWorker::addObserver, worker,
+                    [this](const QString uri) {
+                        invoke(uri, "addObserver", Q_ARG(QString, uri));
+                    });
+            connect(worker, &ServerWorker::removeObserver, worker,
+                    [this](const QString uri) {
+                        invoke(uri, "removeObserver", Q_ARG(QString, uri));
+                    });
+
+            // The worker may process messages as soon as it is in its thread
+            if (sharedThreads.empty())
+                _startDedicatedThread(worker);
+            else
+                _moveToSharedThread(worker);
         }
         catch (const std::runtime_error& e)
         {
@@ -143,27 +205,158 @@ public:
         }
     }
 
+    void setThreadCount(const unsigned int count)
+    {
+        // Previous threads keep serving their connections until they close
+        for (const auto& shared : sharedThreads)
+        {
+            if (shared.connections == 0)
+                shared.thread->quit();
+            else
+                retiredThreads.push_back(shared);
+        }
+        sharedThreads.clear();
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            auto thread = new QThread(this);
+            connect(thread, &QThread::finished, thread, &QThread::deleteLater);
+            thread->start();
+            sharedThreads.push_back({thread, 0});
+        }
+    }
+
+    /** The dispatcher of a stream, always the same one for a given uri. */
+    FrameDispatcher* getDispatcher(const QString& uri) const
+    {
+        return dispatchers[qHash(uri) % dispatchers.size()];
+    }
+
+    /**
+     * Invoke a slot of the dispatcher of a stream, in the thread of the
+     * dispatcher. The calls made from a thread are processed in order.
+     */
+    template <typename... Args>
+    void invoke(const QString& uri, const char* slot, Args&&... args) const
+    {
+        _invoke(getDispatcher(uri), slot, Qt::AutoConnection,
+                std::forward<Args>(args)...);
+    }
+
     Server* server = nullptr;
-    FrameDispatcher* frameDispatcher = nullptr; // owned by QObject's parent
+    SocketMode socketMode = SocketMode::standard;
+
+    /**
+     * Assemble the frames, each in its thread if more than one. The unthreaded
+     * dispatcher is owned by the Server, the threaded ones are deleted when
+     * their thread finishes.
+     */
+    std::vector<FrameDispatcher*> dispatchers;
+    std::vector<QThread*> dispatchingThreads; // owned by QObject's parent
+
+    /** Threads multiplexing the connections, if not one thread for each. */
+    struct SharedThread
+    {
+        QThread* thread; // owned by QObject's parent
+        size_t connections;
+    };
+    std::vector<SharedThread> sharedThreads;
+    std::vector<SharedThread> retiredThreads; // until their connections close
+
+private:
+    void _startDedicatedThread(ServerWorker* worker)
+    {
+        auto workerThread = new QThread(this);
+        worker->moveToThread(workerThread);
+
+        connect(workerThread, &QThread::started, worker,
+                &ServerWorker::initConnection);
+        connect(worker, &ServerWorker::connectionClosed, workerThread,
+                &QThread::quit);
+
+        // Make sure the thread will be deleted
+        connect(workerThread, &QThread::finished, worker,
+                &ServerWorker::deleteLater);
+        connect(workerThread, &QThread::finished, workerThread,
+                &QThread::deleteLater);
+
+        workerThread->start();
+    }
+
+    void _moveToSharedThread(ServerWorker* worker)
+    {
+        auto& shared = *std::min_element(sharedThreads.begin(),
+                                         sharedThreads.end(),
+                                         [](const SharedThread& a,
+                                            const SharedThread& b) {
+                                             return a.connections <
+                                                    b.connections;
+                                         });
+        ++shared.connections;
+
+        const auto thread = shared.thread;
+        worker->moveToThread(thread);
+
+        connect(worker, &ServerWorker::connectionClosed, worker,
+                &ServerWorker::deleteLater);
+        connect(thread, &QThread::finished, worker, &ServerWorker::deleteLater);
+        connect(worker, &QObject::destroyed, this,
+                [this, thread]() { _releaseSharedThread(thread); });
+
+        _invoke(worker, "initConnection", Qt::QueuedConnection);
+    }
+
+    void _releaseSharedThread(QThread* thread)
+    {
+        for (auto& shared : sharedThreads)
+        {
+            if (shared.thread == thread)
+            {
+                --shared.connections;
+                return;
+            }
+        }
+
+        // Threads removed from the pool stop with their last connection
+        for (auto it = retiredThreads.begin(); it != retiredThreads.end(); ++it)
+        {
+            if (it->thread == thread)
+            {
+                if (--it->connections == 0)
+                {
+                    thread->quit();
+                    retiredThreads.erase(it);
+                }
+                return;
+            }
+        }
+    }
 };
 
 Server::Server(const int port)
-    : _impl(new Impl(port, this))
+    : Server(port, 0)
+{
+}
+
+Server::Server(const int port, const unsigned int dispatcherThreads)
+    : _impl(new Impl(port, dispatcherThreads, this))
 {
     // Forward FrameDispatcher signals
-    connect(_impl->frameDispatcher, &FrameDispatcher::pixelStreamOpened, this,
-            &Server::pixelStreamOpened);
-    connect(_impl->frameDispatcher, &FrameDispatcher::pixelStreamClosed, this,
-            &Server::pixelStreamClosed);
-    connect(_impl->frameDispatcher, &FrameDispatcher::sendFrame, this,
-            &Server::receivedFrame);
-    connect(_impl->frameDispatcher, &FrameDispatcher::pixelStreamWarning, this,
-            &Server::pixelStreamException);
-    connect(_impl->frameDispatcher, &FrameDispatcher::pixelStreamError,
-            [this](const QString uri, const QString what) {
-                emit pixelStreamException(uri, what);
-                closePixelStream(uri);
-            });
+    for (auto dispatcher : _impl->dispatchers)
+    {
+        connect(dispatcher, &FrameDispatcher::pixelStreamOpened, this,
+                &Server::pixelStreamOpened);
+        connect(dispatcher, &FrameDispatcher::pixelStreamClosed, this,
+                &Server::pixelStreamClosed);
+        connect(dispatcher, &FrameDispatcher::sendFrame, this,
+                &Server::receivedFrame);
+        connect(dispatcher, &FrameDispatcher::pixelStreamWarning, this,
+                &Server::pixelStreamException);
+        connect(dispatcher, &FrameDispatcher::pixelStreamError, this,
+                [this](const QString uri, const QString what) {
+                    emit pixelStreamException(uri, what);
+                    closePixelStream(uri);
+                });
+    }
 }
 
 Server::~Server()
@@ -176,15 +369,37 @@ quint16 Server::getPort() const
     return _impl->serverPort();
 }
 
+void Server::setSocketMode(const SocketMode mode)
+{
+    _invoke(this, "_setSocketMode", _connectionType(*this),
+            Q_ARG(deflect::SocketMode, mode));
+}
+
+void Server::setThreadCount(const unsigned int count)
+{
+    _invoke(this, "_setThreadCount", _connectionType(*this),
+            Q_ARG(unsigned int, count));
+}
+
 void Server::requestFrame(const QString uri)
 {
-    _impl->frameDispatcher->requestFrame(uri);
+    _impl->invoke(uri, "requestFrame", Q_ARG(QString, uri));
 }
 
 void Server::closePixelStream(const QString uri)
 {
     emit _closePixelStream(uri);
-    _impl->frameDispatcher->deleteStream(uri);
+    _impl->invoke(uri, "deleteStream", Q_ARG(QString, uri));
+}
+
+void Server::_setSocketMode(const SocketMode mode)
+{
+    _impl->socketMode = mode;
+}
+
+void Server::_setThreadCount(const unsigned int count)
+{
+    _impl->setThreadCount(count);
 }
 }
 }
@@ -75,12 +75,61 @@ public:
      */
     explicit Server(int port = defaultPortNumber);
 
+    /**
+     * Create a new server assembling the frames in several threads.
+     *
+     * By default, the frames of all the streams are assembled in the thread
+     * of the Server, so a busy stream delays all the others. With dispatcher
+     * threads, each stream is always assigned to the same thread according to
+     * its uri, and the streams are processed in parallel. The signals of the
+     * Server are still emitted in its own thread.
+     *
+     * @param port The port to listen on. Must be available.
+     * @param dispatcherThreads the number of threads, 0 to use the thread of
+     *        the Server.
+     * @throw std::runtime_error if the server could not be started.
+     * @version 1.1
+     */
+    Server(int port, unsigned int dispatcherThreads);
+
     /** Stop the server and close all open pixel stream connections. */
     ~Server();
 
     /** @return the port on which the server is running. */
     quint16 getPort() const;
 
+    /**
+     * Tune the sockets of the new connections.
+     *
+     * The low latency mode sends the events to the streams immediately. The
+     * throughput mode enlarges the receive buffers, for streams of large
+     * images. The connections which are already open are not affected.
+     *
+     * If called from another thread, waits until the thread of the Server has
+     * applied the setting.
+     *
+     * @param mode the socket mode (default: SocketMode::standard).
+     * @version 1.1
+     */
+    void setSocketMode(SocketMode mode);
+
+    /**
+     * Serve the new connections with a fixed pool of threads.
+     *
+     * By default, each connection gets a dedicated thread, which does not
+     * scale to hundreds of streaming processes. With a pool, the event loop of
+     * each thread multiplexes the sockets of several connections, which are
+     * assigned to the least busy thread. The connections which are already
+     * open are not affected.
+     *
+     * If called from another thread, waits until the thread of the Server has
+     * applied the setting.
+     *
+     * @param count the number of threads, 0 for one thread per connection.
+     * @version 1.1
+     */
+    void setThreadCount(unsigned int count);
+
 public slots:
     /**
      * Request the dispatching of the next frame for a given pixel stream.
@@ -143,7 +192,9 @@ signals:
      * @param uri Identifier for the stream
      * @param exclusive true if the receiver should receive events exclusively
      * @param receiver the event receiver instance
-     * @param success the promise that must receive the success of the operation
+     * @param success the promise that must receive the success of the
+     *        operation. It may be fulfilled later from any thread, the
+     *        connections are served meanwhile.
      */
     void registerToEvents(QString uri, bool exclusive,
                           deflect::server::EventReceiver* receiver,
@@ -169,6 +220,11 @@ private:
     class Impl;
     std::unique_ptr<Impl> _impl;
 
+private slots:
+    // Called in the thread of the Server, which accepts the connections
+    void _setSocketMode(deflect::SocketMode mode);
+    void _setThreadCount(unsigned int count);
+
 signals:
     /** @internal */
     void _closePixelStream(QString uri);
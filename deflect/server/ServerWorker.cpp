@@ -42,21 +42,47 @@
 
 #include "deflect/NetworkProtocol.h"
 #include "deflect/SegmentParameters.h"
+#include "deflect/Socket.h"
 
 #include <QDataStream>
+#include <QTimer>
 
 #include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 
 namespace
 {
-const int RECEIVE_TIMEOUT_MS = 3000;
+const int REGISTRATION_CHECK_MS = 10;
 
 class protocol_error : public std::runtime_error
 {
     using runtime_error::runtime_error;
 };
 
+// The size of uncompressed image data, or 0 if it is compressed
+size_t _getRawSize(const deflect::server::Tile& tile)
+{
+    const size_t width = tile.width;
+    const size_t height = tile.height;
+    switch (tile.format)
+    {
+    case deflect::Format::rgba:
+        return width * height * 4;
+    case deflect::Format::yuv444:
+        return width * height * 3;
+    case deflect::Format::yuv422:
+        return width * height * 2;
+    case deflect::Format::yuv420:
+        return width * height + width * height / 2;
+    default:
+        return 0;
+    }
+}
+
 bool _isProtocolStart(const deflect::MessageType messageType)
 {
     return messageType == deflect::MESSAGE_TYPE_PIXELSTREAM_OPEN ||
@@ -68,7 +94,7 @@ namespace deflect
 {
 namespace server
 {
-ServerWorker::ServerWorker(const int socketDescriptor)
+ServerWorker::ServerWorker(const int socketDescriptor, const SocketMode mode)
     : _tcpSocket{new QTcpSocket(this)} // Ensure that _tcpSocket parent is
                                        // *this* so it gets moved to thread
     , _sourceId{socketDescriptor}
@@ -79,6 +105,8 @@ ServerWorker::ServerWorker(const int socketDescriptor)
         throw std::runtime_error("could not set socket descriptor: " +
                                  _tcpSocket->errorString().toStdString());
     }
+    if (mode != SocketMode::standard)
+        Socket::applyMode(*_tcpSocket, mode);
 
     connect(_tcpSocket, &QTcpSocket::disconnected, this,
             &ServerWorker::connectionClosed);
@@ -156,9 +184,14 @@ void ServerWorker::_receiveMessage()
 {
     try
     {
-        const auto messageHeader = _receiveMessageHeader();
-        const auto messageBody = _receiveMessageBody(messageHeader.size);
-        _handleMessage(messageHeader, messageBody);
+        if (!_receivePendingMessage())
+            return;
+
+        // The body buffer is reused for the next message
+        QByteArray imageData;
+        imageData.swap(_pendingImageData);
+        _hasPendingHeader = false;
+        _handleMessage(_pendingHeader, _pendingBody, std::move(imageData));
     }
     catch (const std::runtime_error& e)
     {
@@ -167,44 +200,114 @@ void ServerWorker::_receiveMessage()
     }
 }
 
-MessageHeader ServerWorker::_receiveMessageHeader()
+bool ServerWorker::_receivePendingMessage()
 {
-    MessageHeader messageHeader;
+    if (!_hasPendingHeader)
+    {
+        if (_tcpSocket->bytesAvailable() < (qint64)_getHeaderSize())
+            return false;
 
-    QDataStream stream(_tcpSocket);
-    stream >> messageHeader;
+        _pendingHeader = _receiveMessageHeader();
+        _hasPendingHeader = true;
+        _allocatePendingMessage();
+    }
 
-    return messageHeader;
+    // The body is read over as many readyRead() as needed, directly into
+    // buffers of its final size
+    const auto bodySize = _pendingBody.size();
+    while (_receivedBytes < int(_pendingHeader.size))
+    {
+        const bool inBody = _receivedBytes < bodySize;
+        auto& buffer = inBody ? _pendingBody : _pendingImageData;
+        const auto offset = inBody ? _receivedBytes : _receivedBytes - bodySize;
+
+        const auto count =
+            _tcpSocket->read(buffer.data() + offset, buffer.size() - offset);
+        if (count < 0)
+            throw std::runtime_error("Error reading message body");
+        if (count == 0)
+            return false;
+        _receivedBytes += int(count);
+    }
+    return true;
 }
 
-QByteArray ServerWorker::_receiveMessageBody(const int size)
+void ServerWorker::_allocatePendingMessage()
 {
-    QByteArray messageData;
+    if (_pendingHeader.size > uint32_t(std::numeric_limits<int>::max()))
+        throw protocol_error("Message is too large");
 
-    if (size > 0)
-    {
-        messageData = _tcpSocket->read(size);
+    // The image data of a segment gets its own buffer, which then becomes the
+    // image data of the tile without being copied
+    const auto size = int(_pendingHeader.size);
+    const auto type = _pendingHeader.type;
+    const bool isSegment = type == MESSAGE_TYPE_PIXELSTREAM ||
+                           type == MESSAGE_TYPE_PIXELSTREAM_SEGMENT;
+    const int parametersSize = sizeof(SegmentParameters);
+    const auto bodySize = isSegment ? std::min(size, parametersSize) : size;
 
-        while (messageData.size() < size)
-        {
-            if (!_tcpSocket->waitForReadyRead(RECEIVE_TIMEOUT_MS))
-                throw std::runtime_error("Timeout reading message data");
+    // Reserving prevents resize() from shrinking the allocation
+    if (bodySize > _pendingBody.capacity())
+        _pendingBody.reserve(bodySize);
+    _pendingBody.resize(bodySize);
+    _pendingImageData = _acquireTileBuffer(size - bodySize);
+    _receivedBytes = 0;
+}
 
-            messageData.append(_tcpSocket->read(size - messageData.size()));
-        }
-    }
+QByteArray ServerWorker::_acquireTileBuffer(const int size)
+{
+    if (size == 0)
+        return QByteArray();
+
+    auto buffer = _tileBuffers.acquire(size);
+    buffer.resize(size);
+    return buffer;
+}
+
+void ServerWorker::_trackTileBuffer(const QByteArray& buffer)
+{
+    _lentTileBuffers.push_back(buffer);
+}
 
-    return messageData;
+void ServerWorker::_recycleTileBuffers()
+{
+    // The application is done with most of the tiles of the frame before the
+    // last one. The pool keeps the buffers which are no longer referenced.
+    _tileBuffers.setMaxBuffers(_previousLentTileBuffers.size());
+    for (auto& buffer : _previousLentTileBuffers)
+        _tileBuffers.release(std::move(buffer));
+    _previousLentTileBuffers.clear();
+    _previousLentTileBuffers.swap(_lentTileBuffers);
+}
+
+MessageHeader ServerWorker::_receiveMessageHeader()
+{
+    char buffer[MessageHeader::serializedSize];
+    const auto size = qint64(_getHeaderSize());
+    if (_tcpSocket->read(buffer, size) != size)
+        throw std::runtime_error("Error reading message header");
+
+    if (_compactHeaders)
+        return MessageHeader::deserializeCompact(buffer);
+    return MessageHeader::deserialize(buffer);
 }
 
 bool ServerWorker::_socketHasMessage() const
 {
-    return _tcpSocket->bytesAvailable() >=
-           (qint64)MessageHeader::serializedSize;
+    if (_hasPendingHeader)
+        return _tcpSocket->bytesAvailable() > 0;
+    return _tcpSocket->bytesAvailable() >= (qint64)_getHeaderSize();
+}
+
+size_t ServerWorker::_getHeaderSize() const
+{
+    return _compactHeaders ? MessageHeader::compactSerializedSize
+                           : MessageHeader::serializedSize;
 }
 
 void ServerWorker::_handleMessage(const MessageHeader& messageHeader,
-                                  const QByteArray& byteArray)
+                                  const QByteArray& byteArray,
+                                  QByteArray&& imageData)
 {
     _validate(messageHeader.type);
 
@@ -223,11 +326,21 @@ void ServerWorker::_handleMessage(const MessageHeader& messageHeader,
         break;
 
     case MESSAGE_TYPE_PIXELSTREAM_FINISH_FRAME:
-        emit receivedFrameFinished(_streamId, _sourceId);
+        _processFrameFinished();
         break;
 
     case MESSAGE_TYPE_PIXELSTREAM:
-        emit receivedTile(_streamId, _sourceId, _parseTile(byteArray));
+        _processTile(byteArray.constData(), byteArray.size(),
+                     std::move(imageData), false);
+        break;
+
+    case MESSAGE_TYPE_PIXELSTREAM_SEGMENT:
+        _processTile(byteArray.constData(), byteArray.size(),
+                     std::move(imageData), true);
+        break;
+
+    case MESSAGE_TYPE_PIXELSTREAM_SEGMENTS:
+        _processTiles(byteArray);
         break;
 
     case MESSAGE_TYPE_SIZE_HINTS:
@@ -269,7 +382,6 @@ void ServerWorker::_handleMessage(const MessageHeader& messageHeader,
     {
         const auto excl = messageHeader.type == MESSAGE_TYPE_BIND_EVENTS_EX;
         _tryRegisteringForEvents(excl);
-        _sendBindReply(_registeredToEvents);
         break;
     }
 
@@ -305,6 +417,11 @@ void ServerWorker::_startProtocol(const QString& uri,
     _observer = observer;
     _parseClientProtocolVersion(byteArray);
 
+    // Clients which do not announce their version use full headers
+    _compactHeaders =
+        !byteArray.isEmpty() &&
+        _clientProtocolVersion >= NETWORK_PROTOCOL_COMPACT_HEADERS_VERSION;
+
     if (_observer)
         emit addObserver(_streamId);
     else
@@ -347,42 +464,182 @@ void ServerWorker::_parseClientProtocolVersion(const QByteArray& message)
         _clientProtocolVersion = version;
 }
 
-Tile ServerWorker::_parseTile(const QByteArray& message) const
+Tile ServerWorker::_parseTile(const char* data, const size_t size,
+                              QByteArray&& imageData,
+                              const bool inlineParameters) const
 {
+    if (size < sizeof(SegmentParameters))
+        throw protocol_error("Segment message is too short");
+
     Tile tile;
 
-    const auto data = message.data();
     const auto params = reinterpret_cast<const SegmentParameters*>(data);
     tile.format = params->format;
     tile.x = params->x;
     tile.y = params->y;
     tile.width = params->width;
     tile.height = params->height;
-    tile.imageData = message.right(message.size() - sizeof(SegmentParameters));
-    tile.view = _activeView;
-    tile.rowOrder = _activeRowOrder;
-    tile.channel = _activeChannel;
+    tile.imageData = std::move(imageData);
+    if (inlineParameters)
+    {
+        if (params->view > View::right_eye)
+            throw protocol_error("Invalid view in segment parameters");
+
+        if (params->flags & ~(SEGMENT_BOTTOM_UP | SEGMENT_RETAINED))
+            throw protocol_error("Invalid flags in segment parameters");
+
+        tile.view = params->view;
+        tile.rowOrder = (params->flags & SEGMENT_BOTTOM_UP)
+                            ? RowOrder::bottom_up
+                            : RowOrder::top_down;
+        tile.channel = params->channel;
+    }
+    else
+    {
+        // Older clients send these parameters in separate messages
+        tile.view = _activeView;
+        tile.rowOrder = _activeRowOrder;
+        tile.channel = _activeChannel;
+    }
 
+    // The applications expect subsampled tiles without partial chroma samples
+    const bool evenX =
+        tile.format == Format::yuv422 || tile.format == Format::yuv420;
+    const bool evenY = tile.format == Format::yuv420;
+    if ((evenX && tile.width % 2 != 0) || (evenY && tile.height % 2 != 0))
+        throw protocol_error("Subsampled segment with odd dimensions");
+
+    // Unchanged tiles have no data
+    const auto rawSize = _getRawSize(tile);
+    if (rawSize > 0 && !tile.imageData.isEmpty() &&
+        size_t(tile.imageData.size()) != rawSize)
+    {
+        throw protocol_error("Uncompressed segment of unexpected size");
+    }
     return tile;
 }
 
+void ServerWorker::_processTiles(const QByteArray& message)
+{
+    // Each segment is prefixed by its size, followed by the same content as a
+    // MESSAGE_TYPE_PIXELSTREAM_SEGMENT payload
+    const auto data = message.constData();
+    const size_t size = message.size();
+    size_t offset = 0;
+    while (offset < size)
+    {
+        if (size - offset < sizeof(uint32_t))
+            throw protocol_error("Truncated segment size in batch");
+
+        uint32_t segmentSize = 0;
+        std::memcpy(&segmentSize, data + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+
+        if (segmentSize > size - offset ||
+            segmentSize < sizeof(SegmentParameters))
+        {
+            throw protocol_error("Truncated segment in batch");
+        }
+
+        // The small segments of a batch share the message buffer, so their
+        // image data is copied
+        const auto params = data + offset;
+        const auto imageSize = int(segmentSize - sizeof(SegmentParameters));
+        auto imageData = _acquireTileBuffer(imageSize);
+        if (imageSize > 0)
+            std::memcpy(imageData.data(), params + sizeof(SegmentParameters),
+                        imageSize);
+        _processTile(params, sizeof(SegmentParameters), std::move(imageData),
+                     true);
+        offset += segmentSize;
+    }
+}
+
+void ServerWorker::_processTile(const char* data, const size_t size,
+                                QByteArray&& imageData,
+                                const bool inlineParameters)
+{
+    auto tile = _parseTile(data, size, std::move(imageData), inlineParameters);
+    if (!tile.imageData.isEmpty())
+        _trackTileBuffer(tile.imageData);
+
+    // Only the tiles which the source may skip in the next frame are kept
+    const auto params = reinterpret_cast<const SegmentParameters*>(data);
+    const bool retained =
+        inlineParameters && (params->flags & SEGMENT_RETAINED);
+
+    const auto key = std::make_tuple(tile.x, tile.y, tile.width, tile.height,
+                                     tile.view, tile.channel);
+
+    // A tile without data is unchanged since the previous frame
+    if (tile.imageData.isEmpty())
+    {
+        const auto it = _previousFrameTiles.find(key);
+        if (it == _previousFrameTiles.end())
+            return; // nothing to display for this tile
+
+        tile.imageData = it->second.imageData;
+        tile.format = it->second.format;
+    }
+
+    if (retained)
+        _currentFrameTiles[key] = tile;
+    _tileQueue->push(std::move(tile));
+}
+
+void ServerWorker::_processFrameFinished()
+{
+    _previousFrameTiles.swap(_currentFrameTiles);
+    _currentFrameTiles.clear();
+    _recycleTileBuffers();
+
+    _tileQueue->finishFrame();
+    emit receivedFrameFinished(_streamId, _sourceId, _tileQueue);
+}
+
 void ServerWorker::_tryRegisteringForEvents(const bool exclusive)
 {
     if (_registeredToEvents)
         throw protocol_error("The stream has already registered for events");
 
+    if (_registration.valid())
+        throw protocol_error("The stream is already registering for events");
+
     auto promise = std::make_shared<std::promise<bool>>();
-    auto future = promise->get_future();
+    _registration = promise->get_future();
 
     emit registerToEvents(_streamId, exclusive, this, std::move(promise));
+    _checkRegistration();
+}
+
+void ServerWorker::_checkRegistration()
+{
+    // The application may answer later, from another thread. Meanwhile this
+    // thread keeps serving its other connections.
+    const auto ready = std::chrono::seconds(0);
+    if (_registration.wait_for(ready) != std::future_status::ready)
+    {
+        if (!_registrationTimer)
+        {
+            _registrationTimer = new QTimer(this);
+            _registrationTimer->setSingleShot(true);
+            _registrationTimer->setInterval(REGISTRATION_CHECK_MS);
+            connect(_registrationTimer, &QTimer::timeout, this,
+                    &ServerWorker::_checkRegistration);
+        }
+        _registrationTimer->start();
+        return;
+    }
 
     try
     {
-        _registeredToEvents = future.get();
+        _registeredToEvents = _registration.get();
     }
     catch (...)
     {
     }
+    _sendBindReply(_registeredToEvents);
+    _sendPendingEvents();
 }
 
 void ServerWorker::_sendProtocolVersion()
@@ -394,6 +651,10 @@ void ServerWorker::_sendProtocolVersion()
 
 void ServerWorker::_sendPendingEvents()
 {
+    // The client expects the reply to its registration first
+    if (_registration.valid())
+        return;
+
     for (const auto& evt : _events)
         _send(evt);
     _events.clear();
@@ -438,17 +699,17 @@ void ServerWorker::_sendQuit()
 
 bool ServerWorker::_send(const MessageHeader& messageHeader)
 {
-    QDataStream stream(_tcpSocket);
-    stream << messageHeader;
+    char buffer[MessageHeader::serializedSize];
+    messageHeader.serialize(buffer);
 
-    return stream.status() == QDataStream::Ok;
+    return _tcpSocket->write(buffer, sizeof(buffer)) == qint64(sizeof(buffer));
 }
 
 void ServerWorker::_flushSocket()
 {
+    // Write what the socket accepts without blocking, the event loop of the
+    // thread writes the rest once the socket is writable again
     _tcpSocket->flush();
-    while (_tcpSocket->bytesToWrite() > 0 && _isConnected())
-        _tcpSocket->waitForBytesWritten();
 }
 
 bool ServerWorker::_isConnected() const
@@ -41,14 +41,23 @@
 #ifndef DEFLECT_SERVER_SERVERWORKER_H
 #define DEFLECT_SERVER_SERVERWORKER_H
 
+#include <deflect/BufferPool.h>
 #include <deflect/Event.h>
 #include <deflect/MessageHeader.h>
 #include <deflect/SizeHints.h>
 #include <deflect/server/EventReceiver.h>
 #include <deflect/server/Tile.h>
+#include <deflect/server/TileQueue.h>
 
 #include <QtNetwork/QTcpSocket>
 
+#include <future>
+#include <map>
+#include <tuple>
+#include <vector>
+
+class QTimer;
+
 namespace deflect
 {
 namespace server
@@ -58,7 +67,8 @@ class ServerWorker : public EventReceiver
     Q_OBJECT
 
 public:
-    explicit ServerWorker(int socketDescriptor);
+    explicit ServerWorker(int socketDescriptor,
+                          SocketMode mode = SocketMode::standard);
     ~ServerWorker();
 
 public slots:
@@ -75,9 +85,8 @@ signals:
     void addObserver(QString uri);
     void removeObserver(QString uri);
 
-    void receivedTile(QString uri, size_t sourceIndex,
-                      deflect::server::Tile tile);
-    void receivedFrameFinished(QString uri, size_t sourceIndex);
+    void receivedFrameFinished(QString uri, size_t sourceIndex,
+                               deflect::server::TileQueuePtr tiles);
     void registerToEvents(QString uri, bool exclusive,
                           deflect::server::EventReceiver* receiver,
                           deflect::server::BoolPromisePtr success);
@@ -94,6 +103,7 @@ signals:
 
 private slots:
     void _processMessages();
+    void _checkRegistration();
 
 private:
     QTcpSocket* _tcpSocket = nullptr; // child QObject
@@ -101,26 +111,56 @@ private:
 
     QString _streamId;
     int _clientProtocolVersion;
+    bool _compactHeaders = false; // sent by the client after the stream open
     bool _observer = false;
 
     bool _registeredToEvents = false;
+    std::future<bool> _registration; // valid until the application answered
+    QTimer* _registrationTimer = nullptr; // child QObject
     std::vector<Event> _events;
 
+    /** Segment parameters sent in separate messages by older clients */
     View _activeView = View::mono;
     RowOrder _activeRowOrder = RowOrder::top_down;
     uint8_t _activeChannel = 0;
 
     bool _protocolEnded = false;
 
+    /** The message being received, whose body may arrive in several parts */
+    MessageHeader _pendingHeader;
+    bool _hasPendingHeader = false;
+    QByteArray _pendingBody;
+    QByteArray _pendingImageData; // of segment messages, read separately
+    int _receivedBytes = 0;
+
+    /** Retained tiles of the last two frames, to complete unchanged tiles */
+    using TileKey =
+        std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, View, uint8_t>;
+    std::map<TileKey, Tile> _currentFrameTiles;
+    std::map<TileKey, Tile> _previousFrameTiles;
+
+    /** Image data of the tiles, reused once the application released it */
+    BufferPool _tileBuffers{0};
+    std::vector<QByteArray> _lentTileBuffers;         // in the current frame
+    std::vector<QByteArray> _previousLentTileBuffers; // in the previous one
+
+    /** The tiles passed to the FrameDispatcher, without a signal for each */
+    TileQueuePtr _tileQueue = std::make_shared<TileQueue>();
+
     void _terminateConnection();
 
     void _receiveMessage();
+    bool _receivePendingMessage();
+    void _allocatePendingMessage();
+    QByteArray _acquireTileBuffer(int size);
+    void _trackTileBuffer(const QByteArray& buffer);
+    void _recycleTileBuffers();
     MessageHeader _receiveMessageHeader();
-    QByteArray _receiveMessageBody(int size);
 
     bool _socketHasMessage() const;
+    size_t _getHeaderSize() const;
     void _handleMessage(const MessageHeader& messageHeader,
-                        const QByteArray& message);
+                        const QByteArray& message, QByteArray&& imageData);
     void _validate(MessageType messageType) const;
     void _startProtocol(const QString& uri, const QByteArray& byteArray,
                         bool observer);
@@ -129,7 +169,12 @@ private:
     bool _isProtocolStarted() const;
 
     void _parseClientProtocolVersion(const QByteArray& message);
-    Tile _parseTile(const QByteArray& message) const;
+    Tile _parseTile(const char* data, size_t size, QByteArray&& imageData,
+                    bool inlineParameters) const;
+    void _processTiles(const QByteArray& message);
+    void _processTile(const char* data, size_t size, QByteArray&& imageData,
+                      bool inlineParameters);
+    void _processFrameFinished();
 
     void _tryRegisteringForEvents(bool exclusive);
 
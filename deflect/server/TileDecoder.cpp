@@ -39,18 +39,34 @@
 
 #include "TileDecoder.h"
 
-#include "ImageJpegDecompressor.h"
+#include "Frame.h"
 #include "Tile.h"
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+#include "ImageJpegDecompressor.h"
+#endif
+
+#include "deflect/BufferPool.h"
 
 #include <QFuture>
 #include <QtConcurrentRun>
 
+#ifdef DEFLECT_USE_LZ4
+#include <lz4.h>
+#endif
+
 #include <iostream>
 
 namespace deflect
 {
 namespace server
 {
+#ifndef DEFLECT_USE_LIBJPEGTURBO
+// Placeholder, JPEG tiles can not be decoded without LibJpegTurbo
+class ImageJpegDecompressor
+{
+};
+#endif
+
 class TileDecoder::Impl
 {
 public:
@@ -58,6 +74,9 @@ public:
     /** The decompressor instance */
     ImageJpegDecompressor decompressor;
 
+    /** Recycled buffers for the decoded images */
+    BufferPool buffers;
+
     /** Async image decoding future */
     QFuture<void> decodingFuture;
 };
@@ -76,7 +95,12 @@ ChromaSubsampling TileDecoder::decodeType(const Tile& tile)
     if (tile.format != Format::jpeg)
         throw std::runtime_error("Tile is not in JPEG format");
 
+#ifdef DEFLECT_USE_LIBJPEGTURBO
     return _impl->decompressor.decompressHeader(tile.imageData).subsampling;
+#else
+    throw std::runtime_error(
+        "LibJpegTurbo not available, needed for decoding JPEG tiles");
+#endif
 }
 
 size_t _getExpectedSize(const Format format, const Tile& tile)
@@ -97,22 +121,42 @@ size_t _getExpectedSize(const Format format, const Tile& tile)
     };
 }
 
-void _decodeTile(ImageJpegDecompressor* decompressor, Tile* tile,
-                 const bool skipRgbConversion)
+#ifdef DEFLECT_USE_LZ4
+void _decodeLz4Tile(BufferPool* buffers, Tile& tile)
 {
-    if (tile->format != Format::jpeg)
-        return;
+    const int expectedSize = int(_getExpectedSize(Format::rgba, tile));
+    QByteArray decodedData = buffers->acquire(expectedSize);
+    decodedData.resize(expectedSize);
+    const int size =
+        LZ4_decompress_safe(tile.imageData.constData(), decodedData.data(),
+                            tile.imageData.size(), decodedData.size());
+    if (size != decodedData.size())
+    {
+        buffers->release(std::move(decodedData));
+        throw std::runtime_error("LZ4 decompression failed");
+    }
 
-    QByteArray decodedData;
+    buffers->release(std::move(tile.imageData));
+    tile.imageData = std::move(decodedData);
+    tile.format = Format::rgba;
+}
+#endif
+
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+void _decodeJpegTile(ImageJpegDecompressor* decompressor, BufferPool* buffers,
+                     Tile* tile, const bool skipRgbConversion)
+{
+    QByteArray decodedData =
+        buffers->acquire(int(_getExpectedSize(Format::rgba, *tile)));
     Format format;
     try
     {
 #ifndef DEFLECT_USE_LEGACY_LIBJPEGTURBO
         if (skipRgbConversion)
         {
-            const auto yuv = decompressor->decompressToYUV(tile->imageData);
-            decodedData = yuv.first;
-            switch (yuv.second)
+            const auto subsampling =
+                decompressor->decompressToYUV(tile->imageData, decodedData);
+            switch (subsampling)
             {
             case ChromaSubsampling::YUV444:
                 format = Format::yuv444;
@@ -132,33 +176,67 @@ void _decodeTile(ImageJpegDecompressor* decompressor, Tile* tile,
         Q_UNUSED(skipRgbConversion);
 #endif
         {
-            decodedData = decompressor->decompress(tile->imageData);
+            decompressor->decompress(tile->imageData, decodedData);
             format = Format::rgba;
         }
     }
     catch (const std::runtime_error&)
     {
+        buffers->release(std::move(decodedData));
         throw;
     }
 
     const auto expectedSize = _getExpectedSize(format, *tile);
     if (size_t(decodedData.size()) != expectedSize)
+    {
+        buffers->release(std::move(decodedData));
         throw std::runtime_error("unexpected tile size");
+    }
 
-    tile->imageData = decodedData;
+    buffers->release(std::move(tile->imageData));
+    tile->imageData = std::move(decodedData);
     tile->format = format;
 }
+#endif
+
+void _decodeTile(ImageJpegDecompressor* decompressor, BufferPool* buffers,
+                 Tile* tile, const bool skipRgbConversion)
+{
+    switch (tile->format)
+    {
+    case Format::jpeg:
+#ifdef DEFLECT_USE_LIBJPEGTURBO
+        _decodeJpegTile(decompressor, buffers, tile, skipRgbConversion);
+        return;
+#else
+        Q_UNUSED(decompressor);
+        Q_UNUSED(skipRgbConversion);
+        throw std::runtime_error(
+            "LibJpegTurbo not available, needed for decoding JPEG tiles");
+#endif
+    case Format::lz4:
+#ifdef DEFLECT_USE_LZ4
+        _decodeLz4Tile(buffers, *tile);
+        return;
+#else
+        throw std::runtime_error(
+            "LZ4 not available, needed for decoding LZ4 tiles");
+#endif
+    default:
+        return; // not compressed
+    }
+}
 
 void TileDecoder::decode(Tile& tile)
 {
-    _decodeTile(&_impl->decompressor, &tile, false);
+    _decodeTile(&_impl->decompressor, &_impl->buffers, &tile, false);
 }
 
 #ifndef DEFLECT_USE_LEGACY_LIBJPEGTURBO
 
 void TileDecoder::decodeToYUV(Tile& tile)
 {
-    _decodeTile(&_impl->decompressor, &tile, true);
+    _decodeTile(&_impl->decompressor, &_impl->buffers, &tile, true);
 }
 
 #endif
@@ -169,8 +247,8 @@ void TileDecoder::startDecoding(Tile& tile)
     if (isRunning())
         return;
 
-    _impl->decodingFuture =
-        QtConcurrent::run(_decodeTile, &_impl->decompressor, &tile, false);
+    _impl->decodingFuture = QtConcurrent::run(_decodeTile, &_impl->decompressor,
+                                              &_impl->buffers, &tile, false);
 }
 
 void TileDecoder::waitDecoding()
@@ -192,5 +270,16 @@ bool TileDecoder::isRunning() const
 {
     return _impl->decodingFuture.isRunning();
 }
+
+void TileDecoder::release(Tile& tile)
+{
+    _impl->buffers.release(std::move(tile.imageData));
+}
+
+void TileDecoder::release(Frame& frame)
+{
+    for (auto& tile : frame.tiles)
+        release(tile);
+}
 }
 }
@@ -69,7 +69,7 @@ public:
     DEFLECT_API ChromaSubsampling decodeType(const Tile& tile);
 
     /**
-     * Decode a JPEG tile to RGB.
+     * Decode a JPEG or LZ4 tile to RGB.
      *
      * @param tile The tile to decode. Upon success, its imageData member
      *        will hold the decompressed RGB image and its "format" flag will
@@ -85,7 +85,8 @@ public:
      *
      * @param tile The tile to decode. Upon success, its imageData member
      *        will hold the decompressed YUV image and its "format" flag will
-     *        be set to the matching Format::yuv4**.
+     *        be set to the matching Format::yuv4**. LZ4 tiles are decoded to
+     *        Format::rgba.
      * @throw std::runtime_error if a decompression error occured
      */
     DEFLECT_API void decodeToYUV(Tile& tile);
@@ -114,6 +115,25 @@ public:
     /** Check if the decoding thread is running. */
     DEFLECT_API bool isRunning() const;
 
+    /**
+     * Give the image data of a tile back to the decoder.
+     *
+     * The memory is then reused for decoding the next tiles, which avoids
+     * allocations when streaming. The tile's image data is left empty.
+     * @param tile The tile, which is no longer used by the caller.
+     * @version 1.1
+     */
+    DEFLECT_API void release(Tile& tile);
+
+    /**
+     * Give the image data of all tiles of a frame back to the decoder.
+     *
+     * @param frame The frame, which is no longer used by the caller.
+     * @see release(Tile&)
+     * @version 1.1
+     */
+    DEFLECT_API void release(Frame& frame);
+
 private:
     class Impl;
     std::unique_ptr<Impl> _impl;
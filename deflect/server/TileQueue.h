@@ -0,0 +1,99 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#ifndef DEFLECT_SERVER_TILEQUEUE_H
+#define DEFLECT_SERVER_TILEQUEUE_H
+
+#include <deflect/server/Tile.h>
+#include <deflect/server/types.h>
+
+#include "deflect/moodycamel/concurrentqueue.h"
+
+namespace deflect
+{
+namespace server
+{
+/**
+ * Pass the tiles of a source from its ServerWorker to the FrameDispatcher.
+ *
+ * The tiles are queued without locking by a single producer thread, and the
+ * end of each frame is marked in the queue. The consumer thread pops the tiles
+ * of a frame once notified that it was finished.
+ */
+class TileQueue
+{
+public:
+    /** Add a tile to the current frame (producer thread only). */
+    void push(Tile&& tile) { _queue.enqueue(_producer, {std::move(tile)}); }
+
+    /** Mark the end of the current frame (producer thread only). */
+    void finishFrame() { _queue.enqueue(_producer, {Tile(), true}); }
+
+    /**
+     * Pop the tiles of the oldest finished frame (consumer thread only).
+     *
+     * @return the tiles of the frame, in the order they were pushed.
+     */
+    Tiles popFrame()
+    {
+        Tiles tiles;
+        Item item;
+        while (_queue.try_dequeue_from_producer(_producer, item))
+        {
+            if (item.endOfFrame)
+                break;
+            tiles.emplace_back(std::move(item.tile));
+        }
+        return tiles;
+    }
+
+private:
+    struct Item
+    {
+        Tile tile;
+        bool endOfFrame = false;
+    };
+
+    moodycamel::ConcurrentQueue<Item> _queue;
+    moodycamel::ProducerToken _producer{_queue};
+};
+}
+}
+
+#endif
@@ -49,6 +49,7 @@ namespace server
 class EventReceiver;
 class FrameDispatcher;
 class TileDecoder;
+class TileQueue;
 class Server;
 
 struct Frame;
@@ -57,6 +58,7 @@ struct Tile;
 using Tiles = std::vector<Tile>;
 using BoolPromisePtr = std::shared_ptr<std::promise<bool>>;
 using FramePtr = std::shared_ptr<Frame>;
+using TileQueuePtr = std::shared_ptr<TileQueue>;
 }
 }
 
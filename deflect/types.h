@@ -78,7 +78,16 @@ enum class Format : std::uint8_t
     jpeg = 1,
     yuv444,
     yuv422,
-    yuv420
+    yuv420,
+    lz4 /**< LZ4-compressed rgba */
+};
+
+/** Tuning of the network sockets. @version 1.1 */
+enum class SocketMode
+{
+    standard,    /**< Keep the defaults of the operating system. */
+    low_latency, /**< Send every message immediately (TCP_NODELAY). */
+    throughput   /**< Large buffers, frames sent in full packets (TCP_CORK). */
 };
 
 /** Cast an enum class value to its underlying type. */
@@ -117,12 +126,14 @@ class ImageSegmenter;
 class Stream;
 
 struct Event;
+struct ImageRegion;
 struct ImageWrapper;
 struct MessageHeader;
 struct Segment;
 struct SegmentParameters;
 struct SizeHints;
 
+using ImageRegions = std::vector<ImageRegion>;
 using Segments = std::vector<Segment>;
 
 /** @internal */
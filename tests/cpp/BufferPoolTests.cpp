@@ -0,0 +1,132 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE BufferPoolTests
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include <deflect/BufferPool.h>
+
+BOOST_AUTO_TEST_CASE(testAcquireReservesCapacity)
+{
+    deflect::BufferPool pool;
+    const auto buffer = pool.acquire(1024);
+    BOOST_CHECK(buffer.isEmpty());
+    BOOST_CHECK_GE(buffer.capacity(), 1024);
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(testReleasedBufferIsReused)
+{
+    deflect::BufferPool pool;
+    auto buffer = pool.acquire(1024);
+    buffer.append(QByteArray(512, 'a'));
+    const void* data = buffer.constData();
+
+    pool.release(std::move(buffer));
+    BOOST_CHECK(buffer.isEmpty());
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+
+    const auto reused = pool.acquire(256);
+    BOOST_CHECK(reused.isEmpty());
+    BOOST_CHECK_EQUAL((const void*)reused.constData(), data);
+    BOOST_CHECK_GE(reused.capacity(), 1024);
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(testReusedBufferGrowsToRequestedCapacity)
+{
+    deflect::BufferPool pool;
+    pool.release(pool.acquire(16));
+    BOOST_REQUIRE_EQUAL(pool.size(), 1u);
+
+    const auto buffer = pool.acquire(4096);
+    BOOST_CHECK_GE(buffer.capacity(), 4096);
+}
+
+BOOST_AUTO_TEST_CASE(testGrownBufferKeepsItsMemory)
+{
+    deflect::BufferPool pool;
+    auto buffer = pool.acquire(0);
+    buffer.append(QByteArray(2048, 'a'));
+
+    pool.release(std::move(buffer));
+    BOOST_REQUIRE_EQUAL(pool.size(), 1u);
+    BOOST_CHECK_GE(pool.acquire(0).capacity(), 2048);
+}
+
+BOOST_AUTO_TEST_CASE(testSharedBufferIsNotRecycled)
+{
+    deflect::BufferPool pool;
+    auto buffer = pool.acquire(1024);
+    buffer.append(QByteArray(512, 'a'));
+    const auto copy = buffer;
+
+    pool.release(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+    BOOST_CHECK(copy == QByteArray(512, 'a'));
+}
+
+BOOST_AUTO_TEST_CASE(testEmptyBufferIsNotRecycled)
+{
+    deflect::BufferPool pool;
+    pool.release(QByteArray());
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(testPoolSizeIsBounded)
+{
+    deflect::BufferPool pool(2);
+    for (int i = 0; i < 4; ++i)
+        pool.release(QByteArray(64, 'a'));
+    BOOST_CHECK_EQUAL(pool.size(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE(testLoweringMaxBuffersFreesTheExcess)
+{
+    deflect::BufferPool pool(4);
+    for (int i = 0; i < 4; ++i)
+        pool.release(QByteArray(64, 'a'));
+    BOOST_REQUIRE_EQUAL(pool.size(), 4u);
+
+    pool.setMaxBuffers(1);
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+    pool.release(QByteArray(64, 'a'));
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+}
@@ -45,6 +45,7 @@ namespace ut = boost::unit_test;
 #include "FrameUtils.h"
 
 #include <deflect/server/FrameDispatcher.h>
+#include <deflect/server/TileQueue.h>
 
 namespace
 {
@@ -99,6 +100,36 @@ BOOST_FIXTURE_TEST_CASE(dispatch_multiple_frames, FixtureFrame)
     compare(frame, *receivedFrame);
 }
 
+BOOST_FIXTURE_TEST_CASE(dispatch_frames_from_tile_queue, FixtureFrame)
+{
+    const auto frame = makeTestFrame(640, 480, 64);
+    auto queue = std::make_shared<deflect::server::TileQueue>();
+
+    // the tiles of the next frame may already be queued
+    for (int i = 0; i < 2; ++i)
+    {
+        for (auto tile : frame.tiles)
+            queue->push(std::move(tile));
+        queue->finishFrame();
+    }
+    auto tile = frame.tiles[0];
+    queue->push(std::move(tile));
+
+    dispatcher.processQueuedFrame(streamId, sourceIndex, queue);
+    dispatcher.requestFrame(streamId);
+    BOOST_REQUIRE(receivedFrame);
+    compare(frame, *receivedFrame);
+
+    receivedFrame = nullptr;
+    dispatcher.processQueuedFrame(streamId, sourceIndex, queue);
+    dispatcher.requestFrame(streamId);
+    BOOST_REQUIRE(receivedFrame);
+    compare(frame, *receivedFrame);
+
+    queue->finishFrame();
+    BOOST_CHECK_EQUAL(queue->popFrame().size(), 1);
+}
+
 BOOST_FIXTURE_TEST_CASE(dispatch_frame_bottom_up, FixtureFrame)
 {
     auto frame = makeTestFrame(640, 480, 64);
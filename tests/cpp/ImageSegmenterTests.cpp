@@ -47,6 +47,9 @@ namespace ut = boost::unit_test;
 
 #include <QMutex>
 
+#include <atomic>
+#include <thread>
+
 static bool append(deflect::Segments& segments, const deflect::Segment& segment)
 {
     static QMutex lock;
@@ -159,6 +162,18 @@ BOOST_AUTO_TEST_CASE(testImageSegmenterSingleSegmentData)
         1,1,1, 2,2,2, 3,3,3, 4,4,4,
         5,5,5, 6,6,6, 7,7,7, 8,8,8
     };
+    const char o = char(0xff);
+    char dataSegmented[] =
+    {
+        1,1,1,o, 2,2,2,o, 3,3,3,o, 4,4,4,o,
+        5,5,5,o, 6,6,6,o, 7,7,7,o, 8,8,8,o,
+        1,1,1,o, 2,2,2,o, 3,3,3,o, 4,4,4,o,
+        5,5,5,o, 6,6,6,o, 7,7,7,o, 8,8,8,o,
+        1,1,1,o, 2,2,2,o, 3,3,3,o, 4,4,4,o,
+        5,5,5,o, 6,6,6,o, 7,7,7,o, 8,8,8,o,
+        1,1,1,o, 2,2,2,o, 3,3,3,o, 4,4,4,o,
+        5,5,5,o, 6,6,6,o, 7,7,7,o, 8,8,8,o
+    };
     // clang-format on
 
     deflect::ImageWrapper imageWrapper(dataIn, 4, 8, deflect::RGB);
@@ -174,9 +189,10 @@ BOOST_AUTO_TEST_CASE(testImageSegmenterSingleSegmentData)
 
     deflect::Segment& segment = segments.front();
     const char* dataOut = segment.imageData.constData();
-    BOOST_CHECK_EQUAL_COLLECTIONS(dataIn, dataIn + imageWrapper.getBufferSize(),
+    BOOST_CHECK_EQUAL_COLLECTIONS(dataSegmented,
+                                  dataSegmented + sizeof(dataSegmented),
                                   dataOut,
-                                  dataOut + imageWrapper.getBufferSize());
+                                  dataOut + segment.imageData.size());
 }
 
 BOOST_AUTO_TEST_CASE(testImageSegmenterUniformSegmentationData)
@@ -194,31 +210,32 @@ BOOST_AUTO_TEST_CASE(testImageSegmenterUniformSegmentationData)
         5,5,5, 6,6,6, 7,7,7, 8,8,8,
         1,1,1, 2,2,2, 3,3,3, 4,4,4
     };
-    char dataSegmented[4][24] =
+    const char o = char(0xff);
+    char dataSegmented[4][32] =
     {
         {
-        1,1,1, 2,2,2,
-        5,5,5, 6,6,6,
-        1,1,1, 2,2,2,
-        5,5,5, 6,6,6
+        1,1,1,o, 2,2,2,o,
+        5,5,5,o, 6,6,6,o,
+        1,1,1,o, 2,2,2,o,
+        5,5,5,o, 6,6,6,o
         },
         {
-        3,3,3, 4,4,4,
-        7,7,7, 8,8,8,
-        3,3,3, 4,4,4,
-        7,7,7, 8,8,8
+        3,3,3,o, 4,4,4,o,
+        7,7,7,o, 8,8,8,o,
+        3,3,3,o, 4,4,4,o,
+        7,7,7,o, 8,8,8,o
         },
         {
-        5,5,5, 6,6,6,
-        1,1,1, 2,2,2,
-        5,5,5, 6,6,6,
-        1,1,1, 2,2,2
+        5,5,5,o, 6,6,6,o,
+        1,1,1,o, 2,2,2,o,
+        5,5,5,o, 6,6,6,o,
+        1,1,1,o, 2,2,2,o
         },
         {
-        7,7,7, 8,8,8,
-        3,3,3, 4,4,4,
-        7,7,7, 8,8,8,
-        3,3,3, 4,4,4
+        7,7,7,o, 8,8,8,o,
+        3,3,3,o, 4,4,4,o,
+        7,7,7,o, 8,8,8,o,
+        3,3,3,o, 4,4,4,o
         }
     };
     // clang-format on
@@ -241,7 +258,7 @@ BOOST_AUTO_TEST_CASE(testImageSegmenterUniformSegmentationData)
     {
         const deflect::Segment& segment = *it;
         const char* dataOut = segment.imageData.constData();
-        BOOST_CHECK_EQUAL_COLLECTIONS(dataSegmented[i], dataSegmented[i] + 24,
+        BOOST_CHECK_EQUAL_COLLECTIONS(dataSegmented[i], dataSegmented[i] + 32,
                                       dataOut,
                                       dataOut + segment.imageData.size());
     }
@@ -262,33 +279,34 @@ BOOST_AUTO_TEST_CASE(testImageSegmenterNonUniformSegmentationData)
         5,5,5, 6,6,6, 7,7,7,   8,8,8,
         1,1,1, 2,2,2, 3,3,3,   4,4,4
     };
+    const char o = char(0xff);
     char dataSegmented0[] =
     {
-        1,1,1, 2,2,2, 3,3,3,
-        5,5,5, 6,6,6, 7,7,7,
-        1,1,1, 2,2,2, 3,3,3,
-        5,5,5, 6,6,6, 7,7,7,
-        5,5,5, 6,6,6, 7,7,7
+        1,1,1,o, 2,2,2,o, 3,3,3,o,
+        5,5,5,o, 6,6,6,o, 7,7,7,o,
+        1,1,1,o, 2,2,2,o, 3,3,3,o,
+        5,5,5,o, 6,6,6,o, 7,7,7,o,
+        5,5,5,o, 6,6,6,o, 7,7,7,o
     };
     char dataSegmented1[] =
     {
-        4,4,4,
-        8,8,8,
-        4,4,4,
-        8,8,8,
-        8,8,8
+        4,4,4,o,
+        8,8,8,o,
+        4,4,4,o,
+        8,8,8,o,
+        8,8,8,o
     };
     char dataSegmented2[] =
     {
-        1,1,1, 2,2,2, 3,3,3,
-        5,5,5, 6,6,6, 7,7,7,
-        1,1,1, 2,2,2, 3,3,3
+        1,1,1,o, 2,2,2,o, 3,3,3,o,
+        5,5,5,o, 6,6,6,o, 7,7,7,o,
+        1,1,1,o, 2,2,2,o, 3,3,3,o
     };
     char dataSegmented3[] =
     {
-        4,4,4,
-        8,8,8,
-        4,4,4
+        4,4,4,o,
+        8,8,8,o,
+        4,4,4,o
     };
     // clang-format on
 
@@ -323,3 +341,524 @@ BOOST_AUTO_TEST_CASE(testImageSegmenterNonUniformSegmentationData)
                                       dataOut + segment.imageData.size());
     }
 }
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterPaddedRows)
+{
+    // clang-format off
+    char dataIn[] =
+    {
+        1,1,1,1, 2,2,2,2, 3,3,3,3,   0,0,
+        4,4,4,4, 5,5,5,5, 6,6,6,6,   0,0,
+        7,7,7,7, 8,8,8,8, 9,9,9,9,   0,0
+    };
+    char dataSegmented[2][24] =
+    {
+        {
+        1,1,1,1, 2,2,2,2,
+        4,4,4,4, 5,5,5,5,
+        7,7,7,7, 8,8,8,8
+        },
+        {
+        3,3,3,3,
+        6,6,6,6,
+        9,9,9,9
+        }
+    };
+    // clang-format on
+
+    deflect::ImageWrapper imageWrapper(dataIn, 3, 3, deflect::RGBA);
+    imageWrapper.pitch = 14;
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::ImageSegmenter segmenter;
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    segmenter.setNominalSegmentDimensions(2, 3);
+    segmenter.generate(imageWrapper, appendFunc);
+    BOOST_REQUIRE_EQUAL(segments.size(), 2);
+
+    for (const auto& segment : segments)
+    {
+        const auto i = segment.parameters.x / 2;
+        const char* dataOut = segment.imageData.constData();
+        BOOST_CHECK_EQUAL_COLLECTIONS(dataSegmented[i],
+                                      dataSegmented[i] +
+                                          segment.imageData.size(),
+                                      dataOut,
+                                      dataOut + segment.imageData.size());
+    }
+    BOOST_CHECK_EQUAL(segments[0].imageData.size() +
+                          segments[1].imageData.size(),
+                      3 * 3 * 4);
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterConvertsUncompressedSegmentsToRGBA)
+{
+    // clang-format off
+    char dataIn[] =
+    {
+        1,2,3, 4,5,6,    7,8,9, 10,11,12,
+        13,14,15, 16,17,18,    19,20,21, 22,23,24
+    };
+    const char o = char(0xff);
+    char dataSegmented[2][16] =
+    {
+        {
+        3,2,1,o, 6,5,4,o,
+        15,14,13,o, 18,17,16,o
+        },
+        {
+        9,8,7,o, 12,11,10,o,
+        21,20,19,o, 24,23,22,o
+        }
+    };
+    // clang-format on
+
+    deflect::ImageWrapper imageWrapper(dataIn, 4, 2, deflect::BGR);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::ImageSegmenter segmenter;
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    segmenter.setNominalSegmentDimensions(2, 2);
+    segmenter.generate(imageWrapper, appendFunc);
+    BOOST_REQUIRE_EQUAL(segments.size(), 2);
+
+    for (const auto& segment : segments)
+    {
+        BOOST_CHECK(segment.parameters.format == deflect::Format::rgba);
+
+        const auto i = segment.parameters.x / 2;
+        const char* dataOut = segment.imageData.constData();
+        BOOST_CHECK_EQUAL_COLLECTIONS(dataSegmented[i], dataSegmented[i] + 16,
+                                      dataOut,
+                                      dataOut + segment.imageData.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterPlanarYUVSegments)
+{
+    // clang-format off
+    char dataIn[] =
+    {
+        // Y
+        1,1, 2,2,
+        1,1, 2,2,
+        // U
+        3, 4,
+        // V
+        5, 6
+    };
+    char dataSegmented[2][6] =
+    {
+        { 1,1, 1,1, 3, 5 },
+        { 2,2, 2,2, 4, 6 }
+    };
+    // clang-format on
+
+    deflect::ImageWrapper imageWrapper(dataIn, 4, 2, deflect::YUV420);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::ImageSegmenter segmenter;
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    segmenter.setNominalSegmentDimensions(2, 2);
+    segmenter.generate(imageWrapper, appendFunc);
+    BOOST_REQUIRE_EQUAL(segments.size(), 2);
+
+    for (const auto& segment : segments)
+    {
+        BOOST_CHECK(segment.parameters.format == deflect::Format::yuv420);
+
+        const auto i = segment.parameters.x / 2;
+        const char* dataOut = segment.imageData.constData();
+        BOOST_CHECK_EQUAL_COLLECTIONS(dataSegmented[i], dataSegmented[i] + 6,
+                                      dataOut,
+                                      dataOut + segment.imageData.size());
+    }
+
+    // Chroma planes can't be split on odd pixels
+    segmenter.setNominalSegmentDimensions(3, 2);
+    BOOST_CHECK_THROW(segmenter.generate(imageWrapper, appendFunc),
+                      std::invalid_argument);
+
+    // Uncompressed segments can't have partial chroma samples
+    segmenter.setNominalSegmentDimensions(0, 0);
+    deflect::ImageWrapper oddImage(dataIn, 3, 2, deflect::YUV420);
+    oddImage.compressionPolicy = deflect::COMPRESSION_OFF;
+    BOOST_CHECK_THROW(segmenter.generate(oddImage, appendFunc),
+                      std::invalid_argument);
+
+#ifdef DEFLECT_USE_LZ4
+    // LZ4 segments are decoded as RGBA
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_LOSSLESS;
+    BOOST_CHECK_THROW(segmenter.generate(imageWrapper, appendFunc),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(segmenter.createSingleSegment(imageWrapper),
+                      std::invalid_argument);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterSkipUnchangedSegments)
+{
+    std::vector<char> dataIn(4 * 8 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 4, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+    imageWrapper.skipUnchangedSegments = true;
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(2, 4);
+
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    // first image: all segments are new
+    segmenter.generate(imageWrapper, appendFunc);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK_EQUAL(segment.imageData.size(), 2 * 4 * 4);
+
+    // same image: all segments are unchanged
+    segments.clear();
+    segmenter.generate(imageWrapper, appendFunc);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK(segment.imageData.isEmpty());
+
+    // modify one pixel of the bottom-right segment
+    dataIn[(7 * 4 + 3) * 4] = 2;
+    segments.clear();
+    segmenter.generate(imageWrapper, appendFunc);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    BOOST_CHECK(segments[0].imageData.isEmpty());
+    BOOST_CHECK(segments[1].imageData.isEmpty());
+    BOOST_CHECK(segments[2].imageData.isEmpty());
+    BOOST_CHECK_EQUAL(segments[3].imageData.size(), 2 * 4 * 4);
+
+    // sending without skipUnchangedSegments resets the segments history
+    imageWrapper.skipUnchangedSegments = false;
+    segments.clear();
+    segmenter.generate(imageWrapper, appendFunc);
+    segmenter.finishFrame();
+    imageWrapper.skipUnchangedSegments = true;
+    segmenter.generate(imageWrapper, appendFunc);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 8);
+    for (const auto& segment : segments)
+        BOOST_CHECK_EQUAL(segment.imageData.size(), 2 * 4 * 4);
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterSkipsOnlySegmentsOfPreviousFrame)
+{
+    std::vector<char> dataIn(4 * 8 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 4, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+    imageWrapper.skipUnchangedSegments = true;
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(2, 4);
+
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    segmenter.generate(imageWrapper, appendFunc);
+    segmenter.finishFrame();
+
+    // a frame where the image is not sent
+    segmenter.finishFrame();
+
+    segments.clear();
+    segmenter.generate(imageWrapper, appendFunc);
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK_EQUAL(segment.imageData.size(), 2 * 4 * 4);
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterDamagedRegions)
+{
+    std::vector<char> dataIn(4 * 8 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 4, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(2, 4);
+
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    // first frame: all segments are sent regardless of the damage
+    const deflect::ImageRegions noDamage;
+    segmenter.generate(imageWrapper, appendFunc, &noDamage);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK_EQUAL(segment.imageData.size(), 2 * 4 * 4);
+
+    // no damage: all segments are unchanged
+    segments.clear();
+    segmenter.generate(imageWrapper, appendFunc, &noDamage);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK(segment.imageData.isEmpty());
+
+    // the damage is trusted, the pixels are not compared
+    dataIn[0] = 2;
+    segments.clear();
+    const deflect::ImageRegions damage{{1, 3, 2, 2}};
+    segmenter.generate(imageWrapper, appendFunc, &damage);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK_EQUAL(segment.imageData.size(), 2 * 4 * 4);
+
+    const deflect::ImageRegions bottomRightDamage{{3, 7, 1, 1}};
+    segments.clear();
+    segmenter.generate(imageWrapper, appendFunc, &bottomRightDamage);
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    BOOST_CHECK(segments[0].imageData.isEmpty());
+    BOOST_CHECK(segments[1].imageData.isEmpty());
+    BOOST_CHECK(segments[2].imageData.isEmpty());
+    BOOST_CHECK_EQUAL(segments[3].imageData.size(), 2 * 4 * 4);
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterRetainsOnlySkippableSegments)
+{
+    std::vector<char> dataIn(4 * 8 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 4, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(2, 4);
+
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    // without damage or checksums, the Server does not need to keep a copy
+    segmenter.generate(imageWrapper, appendFunc);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK(!segment.retained);
+
+    // so the segments cannot be skipped in the next frame
+    segments.clear();
+    const deflect::ImageRegions noDamage;
+    segmenter.generate(imageWrapper, appendFunc, &noDamage);
+    segmenter.finishFrame();
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+    {
+        BOOST_CHECK(segment.retained);
+        BOOST_CHECK_EQUAL(segment.imageData.size(), 2 * 4 * 4);
+    }
+
+    segments.clear();
+    segmenter.generate(imageWrapper, appendFunc, &noDamage);
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK(segment.imageData.isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterPipelinedJobs)
+{
+    std::vector<char> dataIn(4 * 8 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 4, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+    imageWrapper.skipUnchangedSegments = true;
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(2, 4);
+    segmenter.setPipelineDepth(2);
+
+    // two frames started before any of them is handled
+    auto first = segmenter.createJob(imageWrapper);
+    segmenter.finishFrame();
+    segmenter.start(first);
+    auto second = segmenter.createJob(imageWrapper);
+    segmenter.finishFrame();
+    segmenter.start(second);
+
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    BOOST_CHECK(segmenter.handle(first, appendFunc));
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK_EQUAL(segment.imageData.size(), 2 * 4 * 4);
+
+    // the second job is compared with the first one
+    segments.clear();
+    BOOST_CHECK(segmenter.handle(second, appendFunc));
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK(segment.imageData.isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterResendsSegmentsAfterFailedHandling)
+{
+    std::vector<char> dataIn(4 * 8 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 4, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+    imageWrapper.skipUnchangedSegments = true;
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(2, 4);
+    segmenter.setPipelineDepth(2);
+
+    auto first = segmenter.createJob(imageWrapper);
+    segmenter.finishFrame();
+    segmenter.start(first);
+    auto second = segmenter.createJob(imageWrapper);
+    segmenter.finishFrame();
+    segmenter.start(second);
+
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    // the segments of the first job may not have reached the Server...
+    BOOST_CHECK(!segmenter.handle(first, [](const deflect::Segment&) {
+        return false;
+    }));
+
+    // ...so the second job sends them, even if it was compared with them
+    BOOST_CHECK(segmenter.handle(second, appendFunc));
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK_EQUAL(segment.imageData.size(), 2 * 4 * 4);
+
+    // the segments of the second job were handled and can be skipped
+    segments.clear();
+    BOOST_CHECK(segmenter.generate(imageWrapper, appendFunc));
+    BOOST_REQUIRE_EQUAL(segments.size(), 4);
+    for (const auto& segment : segments)
+        BOOST_CHECK(segment.imageData.isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterExternalExecutor)
+{
+    std::vector<char> dataIn(4 * 8 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 4, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    size_t executedTasks = 0;
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(2, 4);
+    segmenter.setExecutor([&](std::function<void()> task) {
+        ++executedTasks;
+        task();
+    });
+
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    BOOST_CHECK(segmenter.generate(imageWrapper, appendFunc));
+    BOOST_CHECK_EQUAL(segments.size(), 4);
+    BOOST_CHECK_EQUAL(executedTasks, 1); // raw segments: a single task
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterConcurrentHandling)
+{
+    std::vector<char> dataIn(4 * 8 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 4, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(2, 4);
+    segmenter.setConcurrentHandling(true);
+
+    const auto callingThread = std::this_thread::get_id();
+    std::atomic<size_t> handledSegments{0};
+    std::atomic<size_t> handledFromCallingThread{0};
+    const auto handler = [&](const deflect::Segment& segment) {
+        if (std::this_thread::get_id() == callingThread)
+            ++handledFromCallingThread;
+        ++handledSegments;
+        return segment.imageData.size() == 2 * 4 * 4;
+    };
+
+    BOOST_CHECK(segmenter.generate(imageWrapper, handler));
+    BOOST_CHECK_EQUAL(handledSegments.load(), 4u);
+    BOOST_CHECK_EQUAL(handledFromCallingThread.load(), 0u);
+
+    // the failure of the handler is reported once all segments are handled
+    handledSegments = 0;
+    BOOST_CHECK(!segmenter.generate(imageWrapper,
+                                    [&](const deflect::Segment&) {
+                                        return ++handledSegments != 2;
+                                    }));
+    BOOST_CHECK_EQUAL(handledSegments.load(), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(testImageSegmenterAdaptiveSegmentation)
+{
+    std::vector<char> dataIn(1024 * 1024 * 4, 1);
+
+    deflect::ImageWrapper imageWrapper(dataIn.data(), 1024, 1024,
+                                       deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    deflect::Segments segments;
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    // Raw segments are generated by a single thread: a few large segments
+    {
+        deflect::ImageSegmenter segmenter;
+        segmenter.setNominalSegmentDimensions(16, 16);
+        segmenter.setAdaptiveSegmentation(true);
+
+        BOOST_CHECK(segmenter.generate(imageWrapper, appendFunc));
+        BOOST_REQUIRE_EQUAL(segments.size(), 4);
+        BOOST_CHECK_EQUAL(segments[0].parameters.width, 512);
+        BOOST_CHECK_EQUAL(segments[0].parameters.height, 512);
+    }
+
+    // Segment dimensions are multiples of the alignment
+    {
+        deflect::ImageSegmenter segmenter;
+        segmenter.setAdaptiveSegmentation(true, 96);
+
+        segments.clear();
+        BOOST_CHECK(segmenter.generate(imageWrapper, appendFunc));
+        BOOST_REQUIRE_EQUAL(segments.size(), 9);
+        BOOST_CHECK_EQUAL(segments[0].parameters.width, 480);
+        BOOST_CHECK_EQUAL(segments[0].parameters.height, 480);
+    }
+
+    // Back to the nominal dimensions
+    {
+        deflect::ImageSegmenter segmenter;
+        segmenter.setNominalSegmentDimensions(256, 256);
+        segmenter.setAdaptiveSegmentation(true);
+        segmenter.setAdaptiveSegmentation(false);
+
+        segments.clear();
+        BOOST_CHECK(segmenter.generate(imageWrapper, appendFunc));
+        BOOST_CHECK_EQUAL(segments.size(), 16);
+    }
+}
@@ -59,6 +59,45 @@ BOOST_AUTO_TEST_CASE(testImageBufferSize)
         deflect::ImageWrapper imageWrapper(data, 256, 512, deflect::RGB);
         BOOST_CHECK_EQUAL(imageWrapper.getBufferSize(), 256 * 512 * 3);
     }
+    {
+        deflect::ImageWrapper imageWrapper(data, 7, 5, deflect::YUV444);
+        BOOST_CHECK_EQUAL(imageWrapper.getBufferSize(), 7 * 5 * 3);
+    }
+    {
+        deflect::ImageWrapper imageWrapper(data, 7, 5, deflect::YUV422);
+        BOOST_CHECK_EQUAL(imageWrapper.getBufferSize(), 7 * 5 + 2 * 4 * 5);
+    }
+    {
+        deflect::ImageWrapper imageWrapper(data, 7, 5, deflect::YUV420);
+        BOOST_CHECK_EQUAL(imageWrapper.getBufferSize(), 7 * 5 + 2 * 4 * 3);
+    }
+    {
+        deflect::ImageWrapper imageWrapper(data, 7, 5, deflect::YUV420);
+        imageWrapper.pitch = 8;
+        BOOST_CHECK_EQUAL(imageWrapper.getBufferSize(),
+                          8 * 5 + 4 * 3 + 4 * 2 + 4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testImagePitch)
+{
+    char* data = nullptr;
+
+    {
+        deflect::ImageWrapper imageWrapper(data, 7, 5, deflect::RGB);
+        BOOST_CHECK_EQUAL(imageWrapper.getPitch(), 7 * 3);
+    }
+    {
+        deflect::ImageWrapper imageWrapper(data, 7, 5, deflect::RGB);
+        imageWrapper.pitch = 24;
+        BOOST_CHECK_EQUAL(imageWrapper.getPitch(), 24);
+        BOOST_CHECK_EQUAL(imageWrapper.getBufferSize(), 24 * 4 + 7 * 3);
+    }
+    {
+        deflect::ImageWrapper imageWrapper(data, 7, 0, deflect::RGB);
+        imageWrapper.pitch = 24;
+        BOOST_CHECK_EQUAL(imageWrapper.getBufferSize(), 0);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(testImageBytesPerPixel)
@@ -89,4 +128,8 @@ BOOST_AUTO_TEST_CASE(testImageBytesPerPixel)
         deflect::ImageWrapper imageWrapper(data, 256, 512, deflect::ABGR);
         BOOST_CHECK_EQUAL(imageWrapper.getBytesPerPixel(), 4);
     }
+    {
+        deflect::ImageWrapper imageWrapper(data, 256, 512, deflect::YUV420);
+        BOOST_CHECK_EQUAL(imageWrapper.getBytesPerPixel(), 1);
+    }
 }
@@ -47,6 +47,8 @@ namespace ut = boost::unit_test;
 #include <QByteArray>
 #include <QDataStream>
 
+#include <cstring>
+
 BOOST_AUTO_TEST_CASE(testMessageHeaderSerialization)
 {
     QByteArray storage;
@@ -66,6 +68,51 @@ BOOST_AUTO_TEST_CASE(testMessageHeaderSerialization)
                       std::string(header.uri));
 }
 
+BOOST_AUTO_TEST_CASE(testMessageHeaderBinaryCodec)
+{
+    const deflect::MessageHeader header(deflect::MESSAGE_TYPE_PIXELSTREAM,
+                                        0x01020304, std::string("MyUri"));
+
+    char buffer[deflect::MessageHeader::serializedSize];
+    header.serialize(buffer);
+
+    // network (big-endian) byte order, as with QDataStream
+    const char expectedFields[] = {0, 0, 0, 5, 1, 2, 3, 4};
+    BOOST_CHECK(std::memcmp(buffer, expectedFields, 8) == 0);
+    BOOST_CHECK_EQUAL(std::string(buffer + 8), "MyUri");
+
+    QByteArray storage;
+    QDataStream dataStreamOut(&storage, QIODevice::Append);
+    dataStreamOut << header;
+    BOOST_REQUIRE_EQUAL(size_t(storage.size()),
+                        deflect::MessageHeader::serializedSize);
+    BOOST_CHECK(std::memcmp(storage.constData(), buffer, storage.size()) == 0);
+
+    const auto deserialized = deflect::MessageHeader::deserialize(buffer);
+    BOOST_CHECK_EQUAL(deserialized.type, header.type);
+    BOOST_CHECK_EQUAL(deserialized.size, header.size);
+    BOOST_CHECK_EQUAL(std::string(deserialized.uri), std::string(header.uri));
+}
+
+BOOST_AUTO_TEST_CASE(testMessageHeaderCompactCodec)
+{
+    const deflect::MessageHeader header(deflect::MESSAGE_TYPE_PIXELSTREAM,
+                                        0x01020304, std::string("MyUri"));
+
+    char buffer[deflect::MessageHeader::compactSerializedSize];
+    header.serializeCompact(buffer);
+
+    const char expected[] = {5, 0, 1, 2, 3, 4};
+    BOOST_REQUIRE_EQUAL(sizeof(buffer), sizeof(expected));
+    BOOST_CHECK(std::memcmp(buffer, expected, sizeof(expected)) == 0);
+
+    const auto deserialized =
+        deflect::MessageHeader::deserializeCompact(buffer);
+    BOOST_CHECK_EQUAL(deserialized.type, header.type);
+    BOOST_CHECK_EQUAL(deserialized.size, header.size);
+    BOOST_CHECK_EQUAL(std::string(deserialized.uri), std::string());
+}
+
 BOOST_AUTO_TEST_CASE(testEventSerialization)
 {
     QByteArray storage;
@@ -0,0 +1,139 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE PixelConverterTests
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include <deflect/PixelConverter.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+// Large enough to use the SIMD kernels plus a scalar remainder
+const size_t pixelCount = 67;
+const uint8_t guard = 0xab;
+
+std::vector<uint8_t> _makePixels(const size_t bytesPerPixel)
+{
+    std::vector<uint8_t> pixels(pixelCount * bytesPerPixel);
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = uint8_t(i * 7 + 3);
+    return pixels;
+}
+
+// Convert with a guard byte to detect writes past the end of the output
+std::vector<uint8_t> _convert(const std::vector<uint8_t>& pixels,
+                              const deflect::PixelFormat format)
+{
+    std::vector<uint8_t> output(pixelCount * 4 + 1, guard);
+    deflect::convertToRgba(pixels.data(), format, output.data(), pixelCount);
+    BOOST_CHECK_EQUAL(output.back(), guard);
+    output.pop_back();
+    return output;
+}
+
+// Index of the R, G, B, A channels in the source pixels, -1 for opaque alpha
+void _checkConversion(const deflect::PixelFormat format,
+                      const std::array<int, 4>& channels)
+{
+    const auto bytesPerPixel = channels[3] < 0 ? 3u : 4u;
+    const auto pixels = _makePixels(bytesPerPixel);
+    const auto output = _convert(pixels, format);
+
+    std::vector<uint8_t> expected(pixelCount * 4);
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        for (size_t c = 0; c < 4; ++c)
+        {
+            const auto channel = channels[c];
+            expected[i * 4 + c] =
+                channel < 0 ? 0xff : pixels[i * bytesPerPixel + channel];
+        }
+    }
+    BOOST_CHECK_EQUAL_COLLECTIONS(output.begin(), output.end(),
+                                  expected.begin(), expected.end());
+}
+}
+
+BOOST_AUTO_TEST_CASE(testConvertRGBA)
+{
+    _checkConversion(deflect::RGBA, {{0, 1, 2, 3}});
+}
+
+BOOST_AUTO_TEST_CASE(testConvertRGB)
+{
+    _checkConversion(deflect::RGB, {{0, 1, 2, -1}});
+}
+
+BOOST_AUTO_TEST_CASE(testConvertBGR)
+{
+    _checkConversion(deflect::BGR, {{2, 1, 0, -1}});
+}
+
+BOOST_AUTO_TEST_CASE(testConvertBGRA)
+{
+    _checkConversion(deflect::BGRA, {{2, 1, 0, 3}});
+}
+
+BOOST_AUTO_TEST_CASE(testConvertARGB)
+{
+    _checkConversion(deflect::ARGB, {{1, 2, 3, 0}});
+}
+
+BOOST_AUTO_TEST_CASE(testConvertABGR)
+{
+    _checkConversion(deflect::ABGR, {{3, 2, 1, 0}});
+}
+
+BOOST_AUTO_TEST_CASE(testConvertShortRows)
+{
+    const uint8_t bgr[] = {1, 2, 3, 4, 5, 6};
+    uint8_t rgba[8] = {0};
+    deflect::convertToRgba(bgr, deflect::BGR, rgba, 2);
+
+    const uint8_t expected[] = {3, 2, 1, 0xff, 6, 5, 4, 0xff};
+    BOOST_CHECK_EQUAL_COLLECTIONS(rgba, rgba + 8, expected, expected + 8);
+
+    deflect::convertToRgba(bgr, deflect::BGR, rgba, 0);
+    BOOST_CHECK_EQUAL_COLLECTIONS(rgba, rgba + 8, expected, expected + 8);
+}
@@ -46,15 +46,35 @@ namespace ut = boost::unit_test;
 #include "MinimalGlobalQtApp.h"
 #include "boost_test_thread_safe.h"
 
+#include <deflect/MessageHeader.h>
 #include <deflect/Stream.h>
 #include <deflect/server/Frame.h>
 
+#include <QRunnable>
+#include <QTcpSocket>
+#include <QThreadPool>
+
 #include <boost/mpl/vector.hpp>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <future>
+#include <thread>
 
 namespace
 {
 const QString testStreamId("teststream");
+
+// Occupies a thread of a QThreadPool until it is released
+struct BlockingTask : public QRunnable
+{
+    explicit BlockingTask(std::shared_future<void> release_)
+        : release(release_)
+    {
+    }
+    void run() final { release.wait(); }
+    std::shared_future<void> release;
+};
 }
 
 BOOST_GLOBAL_FIXTURE(MinimalGlobalQtApp);
@@ -143,6 +163,52 @@ BOOST_AUTO_TEST_CASE(dataReceivedByServer)
     SAFE_BOOST_CHECK(received);
 }
 
+BOOST_AUTO_TEST_CASE(messageBodyReceivedInSeveralParts)
+{
+    const auto sentData = QByteArray(64 * 1024, 'a') + QByteArray(16, 'b');
+
+    QByteArray receivedData;
+    setDataReceivedCallback([&](const QString id, QByteArray data) {
+        SAFE_BOOST_CHECK_EQUAL(id.toStdString(), testStreamId.toStdString());
+        receivedData = data;
+    });
+
+    QTcpSocket socket;
+    socket.connectToHost("localhost", serverPort());
+    BOOST_REQUIRE(socket.waitForConnected());
+    while (socket.bytesAvailable() < qint64(sizeof(int32_t)))
+        BOOST_REQUIRE(socket.waitForReadyRead());
+    socket.read(sizeof(int32_t)); // protocol version
+
+    const auto send = [&](const deflect::MessageType type, const uint32_t size,
+                          const QByteArray& data) {
+        char header[deflect::MessageHeader::serializedSize];
+        deflect::MessageHeader{type, size, testStreamId.toStdString()}
+            .serialize(header);
+        socket.write(header, sizeof(header));
+        socket.write(data);
+        while (socket.bytesToWrite() > 0)
+            socket.waitForBytesWritten();
+    };
+
+    // without a version, the client keeps sending full headers
+    send(deflect::MESSAGE_TYPE_PIXELSTREAM_OPEN, 0, QByteArray());
+    waitForMessage(); // handle stream open
+
+    // a slow client sends the body in parts
+    const auto half = sentData.size() / 2;
+    send(deflect::MESSAGE_TYPE_DATA, sentData.size(), sentData.left(half));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    socket.write(sentData.mid(half));
+    waitForMessage();
+
+    BOOST_CHECK(receivedData == sentData);
+
+    send(deflect::MESSAGE_TYPE_QUIT, 0, QByteArray());
+    waitForMessage(); // handle stream close
+    BOOST_CHECK_EQUAL(getOpenedStreams(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(oneObserverAndOneStream)
 {
     setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
@@ -422,6 +488,56 @@ BOOST_AUTO_TEST_CASE(threadedSmallSegmentStream)
     SAFE_BOOST_CHECK_EQUAL(getReceivedFrames(), expectedFrames);
 }
 
+BOOST_AUTO_TEST_CASE(batchedSmallSegmentsReceivedIntact)
+{
+    const unsigned int segmentSize = 64;
+    const unsigned int gridSize = 8;
+    const unsigned int size = segmentSize * gridSize;
+
+    // every segment is filled with its index, to check where it lands
+    std::vector<std::vector<uint8_t>> pixels;
+    for (unsigned int i = 0; i < gridSize * gridSize; ++i)
+        pixels.emplace_back(segmentSize * segmentSize * 4, uint8_t(i));
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_REQUIRE_EQUAL(frame->tiles.size(), pixels.size());
+        for (const auto& tile : frame->tiles)
+        {
+            const auto index =
+                (tile.y / segmentSize) * gridSize + tile.x / segmentSize;
+            SAFE_BOOST_REQUIRE_EQUAL(tile.imageData.size(),
+                                     pixels[index].size());
+            SAFE_BOOST_CHECK(std::memcmp(tile.imageData.constData(),
+                                         pixels[index].data(),
+                                         pixels[index].size()) == 0);
+        }
+        const auto dim = frame->computeDimensions();
+        SAFE_BOOST_CHECK_EQUAL(dim.width(), size);
+        SAFE_BOOST_CHECK_EQUAL(dim.height(), size);
+    });
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    stream.setConnectionCount(2);
+    waitForMessage(); // handle stream open
+
+    for (unsigned int i = 0; i < pixels.size(); ++i)
+    {
+        deflect::ImageWrapper image(pixels[i].data(), segmentSize,
+                                    segmentSize, deflect::RGBA,
+                                    (i % gridSize) * segmentSize,
+                                    (i / gridSize) * segmentSize);
+        image.compressionPolicy = deflect::COMPRESSION_OFF;
+        BOOST_CHECK(stream.send(image).get());
+    }
+    BOOST_CHECK(stream.finishFrame().get());
+    requestFrame(testStreamId);
+    waitForMessage();
+
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 1);
+}
+
 BOOST_AUTO_TEST_CASE(compressionErrorForBigNullImage)
 {
     deflect::Stream stream(testStreamId.toStdString(), "localhost",
@@ -470,4 +586,376 @@ BOOST_AUTO_TEST_CASE(uncompressedImages)
     BOOST_CHECK_EQUAL(getReceivedFrames(), expectedFrames);
 }
 
+BOOST_AUTO_TEST_CASE(unchangedSegmentsAreCompletedByServer)
+{
+    const unsigned int width = 128;
+    const unsigned int height = 128;
+    const std::vector<uint8_t> pixels(width * height * 4, 42);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+    image.skipUnchangedSegments = true;
+
+    const size_t expectedFrames = 3;
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_REQUIRE_EQUAL(frame->tiles.size(), 1);
+        const auto& tile = frame->tiles[0];
+        SAFE_BOOST_CHECK_EQUAL(tile.imageData.size(), pixels.size());
+        SAFE_BOOST_CHECK_EQUAL(tile.imageData.at(0), 42);
+    });
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+
+    for (size_t i = 0; i < expectedFrames; ++i)
+    {
+        stream.sendAndFinish(image).wait();
+        requestFrame(testStreamId);
+
+        waitForMessage();
+
+        BOOST_CHECK_EQUAL(getReceivedFrames(), i + 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bigUncompressedImageReceivedIntact)
+{
+    // bigger than the socket buffers, to go through partial writes
+    const unsigned int width = 1024;
+    const unsigned int height = 1024;
+    std::vector<uint8_t> pixels(width * height * 4);
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = uint8_t(i % 251);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_REQUIRE_EQUAL(frame->tiles.size(), 4);
+        for (const auto& tile : frame->tiles)
+        {
+            const auto rowSize = tile.width * 4;
+            SAFE_BOOST_REQUIRE_EQUAL(tile.imageData.size(),
+                                     rowSize * tile.height);
+            for (unsigned int y = 0; y < tile.height; ++y)
+            {
+                const auto src = pixels.data() +
+                                 ((tile.y + y) * width + tile.x) * 4;
+                const auto dst = tile.imageData.constData() + y * rowSize;
+                SAFE_BOOST_CHECK(std::memcmp(src, dst, rowSize) == 0);
+            }
+        }
+    });
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+
+    BOOST_CHECK(stream.sendAndFinish(image).get());
+    requestFrame(testStreamId);
+    waitForMessage();
+
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(segmentParametersSentInlineReachTheServer)
+{
+    const unsigned int width = 4;
+    const unsigned int height = 4;
+    const std::vector<uint8_t> pixels(width * height * 4);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+    image.rowOrder = deflect::RowOrder::bottom_up;
+    image.channel = 1;
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_REQUIRE_EQUAL(frame->tiles.size(), 2);
+        size_t leftTiles = 0;
+        for (const auto& tile : frame->tiles)
+        {
+            if (tile.view == deflect::View::left_eye)
+                ++leftTiles;
+            else
+                SAFE_BOOST_CHECK(tile.view == deflect::View::right_eye);
+            SAFE_BOOST_CHECK(tile.rowOrder == deflect::RowOrder::bottom_up);
+            SAFE_BOOST_CHECK_EQUAL(tile.channel, 1);
+        }
+        SAFE_BOOST_CHECK_EQUAL(leftTiles, 1);
+    });
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+
+    image.view = deflect::View::left_eye;
+    BOOST_CHECK(stream.send(image).get());
+    image.view = deflect::View::right_eye;
+    BOOST_CHECK(stream.send(image).get());
+    BOOST_CHECK(stream.finishFrame().get());
+    requestFrame(testStreamId);
+    waitForMessage();
+
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(framesReceivedWithTunedSockets)
+{
+    const unsigned int width = 1024;
+    const unsigned int height = 1024;
+    const std::vector<uint8_t> pixels(width * height * 4, 42);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_REQUIRE_EQUAL(frame->tiles.size(), 4);
+        for (const auto& tile : frame->tiles)
+        {
+            SAFE_BOOST_CHECK_EQUAL(tile.imageData.size(),
+                                   tile.width * tile.height * 4);
+        }
+    });
+
+    const auto modes = {deflect::SocketMode::throughput,
+                        deflect::SocketMode::low_latency,
+                        deflect::SocketMode::standard};
+    size_t expectedFrames = 0;
+    for (const auto mode : modes)
+    {
+        setSocketMode(mode);
+        {
+            deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                                   serverPort());
+            BOOST_REQUIRE(stream.isConnected());
+            stream.setSocketMode(mode);
+            waitForMessage(); // handle stream open
+
+            // the frames must not wait for more segments to fill a packet
+            for (size_t i = 0; i < 2; ++i)
+            {
+                BOOST_CHECK(stream.sendAndFinish(image).get());
+                requestFrame(testStreamId);
+                waitForMessage();
+
+                BOOST_CHECK_EQUAL(getReceivedFrames(), ++expectedFrames);
+            }
+        }
+        waitForMessage(); // handle stream close
+    }
+    BOOST_CHECK_EQUAL(getOpenedStreams(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(streamsServedByThreadPool)
+{
+    setThreadCount(2);
+
+    const unsigned int width = 4;
+    const unsigned int height = 4;
+    const std::vector<uint8_t> pixels(width * height * 4);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+
+    const auto streamId = [](const size_t i) {
+        return testStreamId + QString::number(int(i));
+    };
+
+    // more connections than threads
+    std::vector<std::unique_ptr<deflect::Stream>> streams;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        const auto id = streamId(i).toStdString();
+        streams.emplace_back(
+            new deflect::Stream(id, "localhost", serverPort()));
+        BOOST_REQUIRE(streams.back()->isConnected());
+        waitForMessage(); // handle stream open
+    }
+    BOOST_CHECK_EQUAL(getOpenedStreams(), streams.size());
+
+    for (size_t i = 0; i < streams.size(); ++i)
+    {
+        BOOST_CHECK(streams[i]->sendAndFinish(image).get());
+        requestFrame(streamId(i));
+        waitForMessage();
+
+        BOOST_CHECK_EQUAL(getReceivedFrames(), i + 1);
+    }
+
+    const auto count = streams.size();
+    streams.clear();
+    for (size_t i = 0; i < count; ++i)
+        waitForMessage(); // handle stream close
+    BOOST_CHECK_EQUAL(getOpenedStreams(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(compressionRoutedThroughDedicatedThreads)
+{
+    const unsigned int width = 1024;
+    const unsigned int height = 1024;
+    const std::vector<uint8_t> pixels(width * height * 4, 42);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_ON;
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    waitForMessage(); // handle stream open
+    stream.setCompressionThreads(2);
+
+    // the compression must not need the (blocked) global QThreadPool
+    auto globalPool = QThreadPool::globalInstance();
+    const auto maxThreadCount = globalPool->maxThreadCount();
+    globalPool->setMaxThreadCount(1);
+    std::promise<void> release;
+    globalPool->start(new BlockingTask(release.get_future().share()));
+
+    auto sent = stream.sendAndFinish(image);
+    const auto status = sent.wait_for(std::chrono::seconds(10));
+    release.set_value();
+    globalPool->waitForDone();
+    globalPool->setMaxThreadCount(maxThreadCount);
+
+    BOOST_REQUIRE(status == std::future_status::ready);
+    BOOST_CHECK(sent.get());
+    requestFrame(testStreamId);
+    waitForMessage();
+
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 1);
+}
+
+struct ShardedServer : public DeflectServer
+{
+    ShardedServer()
+        : DeflectServer(2)
+    {
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(streamsDispatchedByThreads, ShardedServer)
+{
+    const unsigned int width = 4;
+    const unsigned int height = 4;
+    const std::vector<uint8_t> pixels(width * height * 4);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+
+    const auto streamId = [](const size_t i) {
+        return testStreamId + QString::number(int(i));
+    };
+
+    // more streams than dispatchers
+    std::vector<std::unique_ptr<deflect::Stream>> streams;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        const auto id = streamId(i).toStdString();
+        streams.emplace_back(
+            new deflect::Stream(id, "localhost", serverPort()));
+        BOOST_REQUIRE(streams.back()->isConnected());
+        waitForMessage(); // handle stream open
+    }
+    BOOST_CHECK_EQUAL(getOpenedStreams(), streams.size());
+
+    for (size_t frame = 0; frame < 2; ++frame)
+    {
+        for (size_t i = 0; i < streams.size(); ++i)
+        {
+            BOOST_CHECK(streams[i]->sendAndFinish(image).get());
+            requestFrame(streamId(i));
+            waitForMessage();
+        }
+    }
+    BOOST_CHECK_EQUAL(getReceivedFrames(), 2 * streams.size());
+
+    const auto count = streams.size();
+    streams.clear();
+    for (size_t i = 0; i < count; ++i)
+        waitForMessage(); // handle stream close
+    BOOST_CHECK_EQUAL(getOpenedStreams(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(segmentsStripedAcrossConnectionsFormOneFrame)
+{
+    const unsigned int width = 1024;
+    const unsigned int height = 1024;
+    const std::vector<uint8_t> pixels(width * height * 4, 42);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+    image.skipUnchangedSegments = true;
+
+    const size_t expectedFrames = 3;
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_REQUIRE_EQUAL(frame->tiles.size(), 4);
+        for (const auto& tile : frame->tiles)
+        {
+            SAFE_BOOST_CHECK_EQUAL(tile.imageData.size(),
+                                   tile.width * tile.height * 4);
+        }
+        const auto dim = frame->computeDimensions();
+        SAFE_BOOST_CHECK_EQUAL(dim.width(), width);
+        SAFE_BOOST_CHECK_EQUAL(dim.height(), height);
+    });
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    stream.setConnectionCount(3);
+    waitForMessage(); // handle stream open
+
+    // unchanged segments are completed by the connection which sent them
+    for (size_t i = 0; i < expectedFrames; ++i)
+    {
+        BOOST_CHECK(stream.sendAndFinish(image).get());
+        requestFrame(testStreamId);
+
+        waitForMessage();
+
+        BOOST_CHECK_EQUAL(getReceivedFrames(), i + 1);
+    }
+    BOOST_CHECK_EQUAL(getOpenedStreams(), 1);
+
+    BOOST_CHECK_THROW(stream.setConnectionCount(4), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(unchangedSegmentsSentAgainAfterRemovingConnections)
+{
+    const unsigned int width = 1024;
+    const unsigned int height = 1024;
+    const std::vector<uint8_t> pixels(width * height * 4, 42);
+    deflect::ImageWrapper image(pixels.data(), width, height, deflect::RGBA);
+    image.compressionPolicy = deflect::COMPRESSION_OFF;
+    image.skipUnchangedSegments = true;
+
+    setFrameReceivedCallback([&](deflect::server::FramePtr frame) {
+        SAFE_BOOST_REQUIRE_EQUAL(frame->tiles.size(), 4);
+        for (const auto& tile : frame->tiles)
+        {
+            SAFE_BOOST_REQUIRE_EQUAL(tile.imageData.size(),
+                                     tile.width * tile.height * 4);
+            SAFE_BOOST_CHECK_EQUAL(tile.imageData.at(0), 42);
+        }
+    });
+
+    deflect::Stream stream(testStreamId.toStdString(), "localhost",
+                           serverPort());
+    BOOST_REQUIRE(stream.isConnected());
+    stream.setConnectionCount(3);
+    waitForMessage(); // handle stream open
+
+    const size_t framesPerCount = 2;
+    for (size_t i = 0; i < 2 * framesPerCount; ++i)
+    {
+        // the segments move to other connections, which never received them
+        if (i == framesPerCount)
+            stream.setConnectionCount(2);
+
+        BOOST_CHECK(stream.sendAndFinish(image).get());
+        requestFrame(testStreamId);
+
+        waitForMessage();
+
+        BOOST_CHECK_EQUAL(getReceivedFrames(), i + 1);
+    }
+    BOOST_CHECK_EQUAL(getOpenedStreams(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
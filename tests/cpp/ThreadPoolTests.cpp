@@ -0,0 +1,116 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE ThreadPoolTests
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include <deflect/ThreadPool.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+
+using CpuList = std::vector<unsigned int>;
+
+BOOST_AUTO_TEST_CASE(testParseCpuList)
+{
+    const auto cpus = deflect::ThreadPool::parseCpuList("0-3,8,10-11");
+    const CpuList expected{0, 1, 2, 3, 8, 10, 11};
+    BOOST_CHECK_EQUAL_COLLECTIONS(cpus.begin(), cpus.end(), expected.begin(),
+                                  expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(testParseCpuListSingleCpuAndEmptyList)
+{
+    BOOST_CHECK(deflect::ThreadPool::parseCpuList("5") == CpuList{5});
+    BOOST_CHECK(deflect::ThreadPool::parseCpuList("").empty());
+    BOOST_CHECK(deflect::ThreadPool::parseCpuList("2-2,") == CpuList{2});
+}
+
+BOOST_AUTO_TEST_CASE(testParseMalformedCpuListThrows)
+{
+    BOOST_CHECK_THROW(deflect::ThreadPool::parseCpuList("a-3"),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(testThreadCount)
+{
+    deflect::ThreadPool pool(3, CpuList());
+    BOOST_CHECK_EQUAL(pool.getThreadCount(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(testZeroThreadsMeansOnePerCpu)
+{
+    deflect::ThreadPool poolOnCpus(0, CpuList{0, 0});
+    BOOST_CHECK_EQUAL(poolOnCpus.getThreadCount(), 2u);
+
+    deflect::ThreadPool pool(0, CpuList());
+    const auto hardwareThreads = std::thread::hardware_concurrency();
+    BOOST_CHECK_EQUAL(pool.getThreadCount(),
+                      std::max(hardwareThreads, 1u));
+}
+
+BOOST_AUTO_TEST_CASE(testFunctionsAreExecutedByThePoolThreads)
+{
+    deflect::ThreadPool pool(2, CpuList());
+    std::promise<std::thread::id> promise;
+    auto future = promise.get_future();
+    pool.execute([&promise] { promise.set_value(std::this_thread::get_id()); });
+
+    BOOST_REQUIRE(future.wait_for(std::chrono::seconds(10)) ==
+                  std::future_status::ready);
+    BOOST_CHECK(future.get() != std::this_thread::get_id());
+}
+
+BOOST_AUTO_TEST_CASE(testDestructorExecutesPendingFunctions)
+{
+    std::atomic<size_t> executed{0};
+    {
+        deflect::ThreadPool pool(1, CpuList());
+        // keep the thread busy so that the next functions are still pending
+        pool.execute([&executed] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            ++executed;
+        });
+        for (size_t i = 0; i < 100; ++i)
+            pool.execute([&executed] { ++executed; });
+    }
+    BOOST_CHECK_EQUAL(executed, 101u);
+}
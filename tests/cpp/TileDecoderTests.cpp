@@ -230,6 +230,49 @@ BOOST_AUTO_TEST_CASE(testImageCompressionAndDecompressionYUV)
                                 &decodeToYUVWithTileDecoder);
 }
 
+BOOST_AUTO_TEST_CASE(testPlanarYUVImageCompressionAndDecompression)
+{
+    const std::vector<std::pair<deflect::PixelFormat,
+                                deflect::ChromaSubsampling>>
+        formats = {{deflect::YUV444, deflect::ChromaSubsampling::YUV444},
+                   {deflect::YUV422, deflect::ChromaSubsampling::YUV422},
+                   {deflect::YUV420, deflect::ChromaSubsampling::YUV420}};
+
+    for (const auto& format : formats)
+    {
+        // Planar YUV data, no RGB -> YUV conversion needed
+        const size_t imageSize = 8 * 8;
+        auto uvSize = imageSize;
+        if (format.first == deflect::YUV422)
+            uvSize >>= 1;
+        else if (format.first == deflect::YUV420)
+            uvSize >>= 2;
+
+        std::vector<char> data(expectedYData);
+        data.insert(data.end(), expectedUData.begin(),
+                    expectedUData.begin() + uvSize);
+        data.insert(data.end(), expectedVData.begin(),
+                    expectedVData.begin() + uvSize);
+
+        deflect::ImageWrapper imageWrapper(data.data(), 8, 8, format.first);
+        imageWrapper.compressionQuality = 100;
+        BOOST_REQUIRE_EQUAL(imageWrapper.getBufferSize(), data.size());
+
+        deflect::ImageJpegCompressor compressor;
+        const auto jpegData =
+            compressor.computeJpeg(imageWrapper, QRect(0, 0, 8, 8));
+        BOOST_REQUIRE(jpegData.size() > 0);
+
+        const auto yuvImageData =
+            decodeToYUVWithDecompressor(jpegData, format.second);
+        BOOST_REQUIRE_EQUAL(yuvImageData.size(), data.size());
+
+        const char* dataOut = yuvImageData.constData();
+        BOOST_CHECK_EQUAL_COLLECTIONS(data.data(), data.data() + data.size(),
+                                      dataOut, dataOut + data.size());
+    }
+}
+
 #endif
 
 static bool append(deflect::Segments& segments, const deflect::Segment& segment)
@@ -282,6 +325,57 @@ BOOST_AUTO_TEST_CASE(testImageSegmentationWithCompressionAndDecompression)
                                   dataOut + tile.imageData.size());
 }
 
+#ifdef DEFLECT_USE_LZ4
+
+BOOST_AUTO_TEST_CASE(testImageSegmentationWithLosslessCompression)
+{
+    // Vector of rgba data
+    const auto data = makeTestImage();
+
+    // Compress image
+    deflect::ImageWrapper imageWrapper(data.data(), 8, 8, deflect::RGBA);
+    imageWrapper.compressionPolicy = deflect::COMPRESSION_LOSSLESS;
+
+    deflect::Segments segments;
+    deflect::ImageSegmenter segmenter;
+    segmenter.setNominalSegmentDimensions(4, 8);
+    const auto appendFunc =
+        std::bind(&append, std::ref(segments), std::placeholders::_1);
+
+    segmenter.generate(imageWrapper, appendFunc);
+    BOOST_REQUIRE_EQUAL(segments.size(), 2);
+
+    for (const auto& segment : segments)
+    {
+        BOOST_REQUIRE_EQUAL(segment.parameters.format, deflect::Format::lz4);
+        BOOST_REQUIRE(segment.imageData.size() < 4 * 8 * 4);
+
+        // Decompress image
+        deflect::server::Tile tile;
+        tile.width = segment.parameters.width;
+        tile.height = segment.parameters.height;
+        tile.format = segment.parameters.format;
+        tile.imageData = segment.imageData;
+
+        deflect::server::TileDecoder decoder;
+        decoder.decode(tile);
+
+        // Check decoded image in format RGBA, pixel-exact
+        BOOST_REQUIRE_EQUAL(tile.format, deflect::Format::rgba);
+        BOOST_REQUIRE_EQUAL(tile.imageData.size(), 4 * 8 * 4);
+
+        for (size_t y = 0; y < tile.height; ++y)
+        {
+            const auto row = data.data() + (y * 8 + segment.parameters.x) * 4;
+            const auto dataOut = tile.imageData.constData() + y * 4 * 4;
+            BOOST_CHECK_EQUAL_COLLECTIONS(row, row + 4 * 4, dataOut,
+                                          dataOut + 4 * 4);
+        }
+    }
+}
+
+#endif
+
 BOOST_AUTO_TEST_CASE(testDecompressionOfInvalidData)
 {
     const QByteArray invalidJpegData{"notjpeg923%^#8"};
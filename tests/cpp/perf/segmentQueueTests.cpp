@@ -0,0 +1,142 @@
+/*********************************************************************/
+/* Copyright (c) 2018, EPFL/Blue Brain Project                       */
+/*                     Raphael Dumusc <raphael.dumusc@epfl.ch>       */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/*   1. Redistributions of source code must retain the above         */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer.                                                  */
+/*                                                                   */
+/*   2. Redistributions in binary form must reproduce the above      */
+/*      copyright notice, this list of conditions and the following  */
+/*      disclaimer in the documentation and/or other materials       */
+/*      provided with the distribution.                              */
+/*                                                                   */
+/*    THIS  SOFTWARE  IS  PROVIDED  BY  THE  ECOLE  POLYTECHNIQUE    */
+/*    FEDERALE DE LAUSANNE  ''AS IS''  AND ANY EXPRESS OR IMPLIED    */
+/*    WARRANTIES, INCLUDING, BUT  NOT  LIMITED  TO,  THE  IMPLIED    */
+/*    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR    */
+/*    PURPOSE  ARE  DISCLAIMED.  IN  NO  EVENT  SHALL  THE  ECOLE    */
+/*    POLYTECHNIQUE  FEDERALE  DE  LAUSANNE  OR  CONTRIBUTORS  BE    */
+/*    LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,    */
+/*    EXEMPLARY,  OR  CONSEQUENTIAL  DAMAGES  (INCLUDING, BUT NOT    */
+/*    LIMITED TO,  PROCUREMENT  OF  SUBSTITUTE GOODS OR SERVICES;    */
+/*    LOSS OF USE, DATA, OR  PROFITS;  OR  BUSINESS INTERRUPTION)    */
+/*    HOWEVER CAUSED AND  ON ANY THEORY OF LIABILITY,  WHETHER IN    */
+/*    CONTRACT, STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE    */
+/*    OR OTHERWISE) ARISING  IN ANY WAY  OUT OF  THE USE OF  THIS    */
+/*    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.   */
+/*                                                                   */
+/* The views and conclusions contained in the software and           */
+/* documentation are those of the authors and should not be          */
+/* interpreted as representing official policies, either expressed   */
+/* or implied, of Ecole polytechnique federale de Lausanne.          */
+/*********************************************************************/
+
+#define BOOST_TEST_MODULE SegmentQueue
+#include <boost/test/unit_test.hpp>
+namespace ut = boost::unit_test;
+
+#include "Timer.h"
+
+#include <deflect/MTQueue.h>
+#include <deflect/Segment.h>
+#include <deflect/moodycamel/blockingconcurrentqueue.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Compares the queues which can collect the segments from the compression
+// threads: many producers enqueue segments which a single consumer (the send
+// thread) dequeues, as in ImageSegmenter::handle().
+
+namespace
+{
+const size_t SEGMENTS_PER_PRODUCER = 100000;
+const int SEGMENT_SIZE = 1024;
+
+size_t _getProducerCount()
+{
+    return std::max(2u, std::thread::hardware_concurrency());
+}
+
+deflect::Segment _makeSegment()
+{
+    deflect::Segment segment;
+    segment.imageData = QByteArray(SEGMENT_SIZE, 'a');
+    return segment;
+}
+
+template <typename Enqueue, typename Dequeue>
+float _benchmark(Enqueue enqueue, Dequeue dequeue)
+{
+    const auto producerCount = _getProducerCount();
+    const auto total = producerCount * SEGMENTS_PER_PRODUCER;
+    const auto segment = _makeSegment();
+
+    Timer timer;
+    timer.start();
+
+    std::vector<std::thread> producers;
+    for (size_t i = 0; i < producerCount; ++i)
+    {
+        producers.emplace_back([&enqueue, &segment] {
+            for (size_t j = 0; j < SEGMENTS_PER_PRODUCER; ++j)
+            {
+                auto copy = segment;
+                enqueue(std::move(copy));
+            }
+        });
+    }
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < total; ++i)
+        bytes += size_t(dequeue().imageData.size());
+
+    for (auto& producer : producers)
+        producer.join();
+
+    const auto elapsed = timer.elapsed();
+    BOOST_CHECK_EQUAL(bytes, total * SEGMENT_SIZE);
+    return elapsed;
+}
+
+void _print(const char* name, const float elapsed)
+{
+    const auto total = _getProducerCount() * SEGMENTS_PER_PRODUCER;
+    std::cout << name << ": " << total / elapsed / 1e6 << " M segments/s ("
+              << _getProducerCount() << " producers)" << std::endl;
+}
+}
+
+BOOST_AUTO_TEST_CASE(testMTQueue)
+{
+    deflect::MTQueue<deflect::Segment> queue;
+    const auto elapsed = _benchmark(
+        [&queue](deflect::Segment&& segment) {
+            queue.enqueue(std::move(segment));
+        },
+        [&queue] { return queue.dequeue(); });
+    _print("MTQueue", elapsed);
+}
+
+BOOST_AUTO_TEST_CASE(testBlockingConcurrentQueue)
+{
+    moodycamel::BlockingConcurrentQueue<deflect::Segment> queue;
+    const auto elapsed = _benchmark(
+        [&queue](deflect::Segment&& segment) {
+            queue.enqueue(std::move(segment));
+        },
+        [&queue] {
+            deflect::Segment segment;
+            queue.wait_dequeue(segment);
+            return segment;
+        });
+    _print("BlockingConcurrentQueue", elapsed);
+}
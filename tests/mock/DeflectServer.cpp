@@ -42,9 +42,10 @@
 
 #include <boost/test/unit_test.hpp>
 
-DeflectServer::DeflectServer()
+DeflectServer::DeflectServer(const unsigned int dispatcherThreads)
 {
-    _server = new deflect::server::Server(0 /* OS-chosen port */);
+    _server = new deflect::server::Server(0 /* OS-chosen port */,
+                                          dispatcherThreads);
     _server->moveToThread(&_thread);
     _thread.connect(&_thread, &QThread::finished, _server,
                     &deflect::server::Server::deleteLater);
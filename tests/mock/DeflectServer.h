@@ -54,10 +54,15 @@ typedef __int32 int32_t;
 class DeflectServer
 {
 public:
-    explicit DeflectServer();
+    explicit DeflectServer(unsigned int dispatcherThreads = 0);
     ~DeflectServer();
 
     quint16 serverPort() const { return _server->getPort(); }
+    void setSocketMode(deflect::SocketMode mode)
+    {
+        _server->setSocketMode(mode);
+    }
+    void setThreadCount(unsigned int count) { _server->setThreadCount(count); }
     void requestFrame(QString uri);
     void waitForMessage();
 